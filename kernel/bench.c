@@ -0,0 +1,689 @@
+//
+// in-kernel benchmark runner, built with make BENCH=1.
+//
+// each benchmark is a small user program that times itself
+// with rdcycle and reports the result as its exit status.
+// a kernel thread starts them one at a time once the
+// system is up, and prints what they report. the disk
+// benchmarks then run in the thread itself.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "blk.h"
+#include "buf.h"
+#include "file.h"
+#include "defs.h"
+
+extern struct superblock sb;
+extern int fs_readahead;
+
+// makes 100000 null system calls; exits with the
+// average cycles per call.
+// assembled from ../user/nullbench.S
+// od -t xC ../user/nullbench
+static uchar nullbench[] = {
+  0x37, 0x84, 0x01, 0x00, 0x1b, 0x04, 0x04, 0x6a,
+  0x93, 0x04, 0x04, 0x00, 0x73, 0x29, 0x00, 0xc0,
+  0x93, 0x08, 0x80, 0x01, 0x73, 0x00, 0x00, 0x00,
+  0x93, 0x84, 0xf4, 0xff, 0xe3, 0x9a, 0x04, 0xfe,
+  0xf3, 0x29, 0x00, 0xc0, 0x33, 0x85, 0x29, 0x41,
+  0x33, 0x55, 0x85, 0x02, 0x93, 0x08, 0x20, 0x00,
+  0x73, 0x00, 0x00, 0x00, 0x6f, 0x00, 0x00, 0x00
+};
+
+// yields 10000 times; exits with the average
+// cycles per yield.
+// assembled from ../user/switchbench.S
+static uchar switchbench[] = {
+  0x37, 0x24, 0x00, 0x00, 0x1b, 0x04, 0x04, 0x71,
+  0x93, 0x04, 0x04, 0x00, 0x73, 0x29, 0x00, 0xc0,
+  0x93, 0x08, 0xb0, 0x01, 0x73, 0x00, 0x00, 0x00,
+  0x93, 0x84, 0xf4, 0xff, 0xe3, 0x9a, 0x04, 0xfe,
+  0xf3, 0x29, 0x00, 0xc0, 0x33, 0x85, 0x29, 0x41,
+  0x33, 0x55, 0x85, 0x02, 0x93, 0x08, 0x20, 0x00,
+  0x73, 0x00, 0x00, 0x00, 0x6f, 0x00, 0x00, 0x00
+};
+
+// the same, but dirties an FP register between yields.
+// assembled from ../user/fpswitchbench.S
+static uchar fpswitchbench[] = {
+  0x37, 0x24, 0x00, 0x00, 0x1b, 0x04, 0x04, 0x71,
+  0x93, 0x04, 0x04, 0x00, 0x73, 0x29, 0x00, 0xc0,
+  0x53, 0x70, 0x10, 0x02, 0x93, 0x08, 0xb0, 0x01,
+  0x73, 0x00, 0x00, 0x00, 0x93, 0x84, 0xf4, 0xff,
+  0xe3, 0x98, 0x04, 0xfe, 0xf3, 0x29, 0x00, 0xc0,
+  0x33, 0x85, 0x29, 0x41, 0x33, 0x55, 0x85, 0x02,
+  0x93, 0x08, 0x20, 0x00, 0x73, 0x00, 0x00, 0x00,
+  0x6f, 0x00, 0x00, 0x00
+};
+
+// calls IPC endpoint 0 10000 times; exits with
+// the average cycles per round trip.
+// assembled from ../user/ipcbench.S
+static uchar ipcbench[] = {
+  0x37, 0x24, 0x00, 0x00, 0x1b, 0x04, 0x04, 0x71,
+  0x93, 0x04, 0x04, 0x00, 0x73, 0x29, 0x00, 0xc0,
+  0x13, 0x05, 0x00, 0x00, 0x93, 0x85, 0x04, 0x00,
+  0x93, 0x08, 0xc0, 0x01, 0x73, 0x00, 0x00, 0x00,
+  0x93, 0x84, 0xf4, 0xff, 0xe3, 0x96, 0x04, 0xfe,
+  0xf3, 0x29, 0x00, 0xc0, 0x33, 0x85, 0x29, 0x41,
+  0x33, 0x55, 0x85, 0x02, 0x93, 0x08, 0x20, 0x00,
+  0x73, 0x00, 0x00, 0x00, 0x6f, 0x00, 0x00, 0x00
+};
+
+// answers calls on endpoint 0 until killed.
+// assembled from ../user/ipcserver.S
+static uchar ipcserver[] = {
+  0x93, 0x05, 0x00, 0x00, 0x13, 0x05, 0x00, 0x00,
+  0x93, 0x08, 0xe0, 0x01, 0x73, 0x00, 0x00, 0x00,
+  0x93, 0x85, 0x15, 0x00, 0x6f, 0xf0, 0x1f, 0xff
+};
+
+// pushes 1MB through a pipe, a message at a time, with
+// write() and read(), or with vmsplice() if its argument is
+// negative; exits with the cycles per KB.
+// assembled from ../user/pipebench.S
+static uchar pipebench[] = {
+  0x93, 0x0b, 0x00, 0x01, 0x13, 0x0c, 0x50, 0x00,
+  0x63, 0x58, 0x05, 0x00, 0x33, 0x05, 0xa0, 0x40,
+  0x93, 0x0b, 0x20, 0x02, 0x13, 0x0c, 0x20, 0x02,
+  0x13, 0x0a, 0x05, 0x00, 0x37, 0x05, 0x01, 0x00,
+  0x93, 0x08, 0xc0, 0x00, 0x73, 0x00, 0x00, 0x00,
+  0x93, 0x0c, 0x05, 0x00, 0xb7, 0x82, 0x00, 0x00,
+  0x33, 0x8d, 0x5c, 0x00, 0x13, 0x01, 0x01, 0xff,
+  0x13, 0x05, 0x01, 0x00, 0x93, 0x08, 0x40, 0x00,
+  0x73, 0x00, 0x00, 0x00, 0x83, 0x2a, 0x01, 0x00,
+  0x03, 0x2b, 0x41, 0x00, 0xb7, 0x02, 0x10, 0x00,
+  0xb3, 0xd4, 0x42, 0x03, 0x73, 0x29, 0x00, 0xc0,
+  0x13, 0x05, 0x0b, 0x00, 0x93, 0x85, 0x0c, 0x00,
+  0x13, 0x06, 0x0a, 0x00, 0x93, 0x88, 0x0b, 0x00,
+  0x73, 0x00, 0x00, 0x00, 0x13, 0x85, 0x0a, 0x00,
+  0x93, 0x05, 0x0d, 0x00, 0x13, 0x06, 0x0a, 0x00,
+  0x93, 0x08, 0x0c, 0x00, 0x73, 0x00, 0x00, 0x00,
+  0x93, 0x84, 0xf4, 0xff, 0xe3, 0x9a, 0x04, 0xfc,
+  0xf3, 0x29, 0x00, 0xc0, 0x33, 0x85, 0x29, 0x41,
+  0x13, 0x55, 0xa5, 0x00, 0x93, 0x08, 0x20, 0x00,
+  0x73, 0x00, 0x00, 0x00, 0x6f, 0x00, 0x00, 0x00
+};
+
+static struct bench {
+  char *name;
+  uchar *code;
+  uint sz;
+  char *what;       // what the exit status measures
+  uchar *server;    // started first, and killed after
+  uint serversz;
+  long arg;         // passed in a0
+} benches[] = {
+  { "nullbench", nullbench, sizeof(nullbench), "cycles per null syscall" },
+  { "switchbench", switchbench, sizeof(switchbench), "cycles per yield" },
+  { "fpswitchbench", fpswitchbench, sizeof(fpswitchbench), "cycles per yield, using FP" },
+  { "ipcbench", ipcbench, sizeof(ipcbench), "cycles per IPC round trip",
+    ipcserver, sizeof(ipcserver) },
+  { "pipebench", pipebench, sizeof(pipebench), "cycles per KB, 64-byte writes", 0, 0, 64 },
+  { "pipebench", pipebench, sizeof(pipebench), "cycles per KB, 512-byte writes", 0, 0, 512 },
+  { "pipebench", pipebench, sizeof(pipebench), "cycles per KB, 4KB writes", 0, 0, 4096 },
+  { "pipebench", pipebench, sizeof(pipebench), "cycles per KB, 32KB writes", 0, 0, 32768 },
+  { "pipebench", pipebench, sizeof(pipebench), "cycles per KB, 4KB vmsplice", 0, 0, -4096 },
+  { "pipebench", pipebench, sizeof(pipebench), "cycles per KB, 32KB vmsplice", 0, 0, -32768 },
+};
+
+static void
+runbench(struct bench *b)
+{
+  int pid, spid, status, r;
+
+  spid = -1;
+  if(b->server && (spid = uspawn("server", b->server, b->serversz, 0)) < 0){
+    printf("%s: cannot start server\n", b->name);
+    return;
+  }
+  if((pid = uspawn(b->name, b->code, b->sz, b->arg)) < 0){
+    printf("%s: cannot start\n", b->name);
+  } else {
+    while((r = wait(&status)) >= 0 && r != pid)
+      ;
+    if(r == pid)
+      printf("%s: %d %s\n", b->name, status, b->what);
+  }
+  if(spid >= 0){
+    kill(spid);
+    wait(0);
+  }
+}
+
+// disk benchmarks: BLKNREQ requests of len bytes, keeping up
+// to qd of them in flight, to sequential or random blocks in
+// the scratch space after the file system (see the Makefile).
+#define BLKNREQ 4096
+#define BLKMAXQD 32
+
+static struct blkbench {
+  char *what;
+  int write;
+  int random;
+  int qd;
+  int len;
+} blkbenches[] = {
+  { "sequential read", 0, 0, 1, PGSIZE },
+  { "sequential read", 0, 0, BLKMAXQD, PGSIZE },
+  { "random read", 0, 1, 1, PGSIZE },
+  { "random read", 0, 1, BLKMAXQD, PGSIZE },
+  { "random read", 0, 1, BLKMAXQD, BLKSECT },
+  { "sequential write", 1, 0, BLKMAXQD, PGSIZE },
+  { "random write", 1, 1, BLKMAXQD, PGSIZE },
+};
+
+// the benchmark that runs on 1, 2, ... harts at once,
+// to see how the disk's queues scale.
+static struct blkbench blkscalebench = { "random read", 0, 1, BLKMAXQD, PGSIZE };
+
+// the first scratch sector, and how many there are.
+static uint64 blkbase, blksects;
+
+// one hart's run of a disk benchmark.
+static struct blkjob {
+  struct spinlock lock;
+  struct blkbench *b;
+  uint64 seed;
+  struct blkreq reqs[BLKMAXQD];
+  struct blkreq *free;   // completed, ready to reuse
+  int ndone;
+  int err;
+} blkjobs[NCPU];
+
+// the scaling benchmark's jobs that are still running.
+static struct {
+  struct spinlock lock;
+  int running;
+} blkscale;
+
+static void
+blkdone(struct blkreq *r)
+{
+  struct blkjob *j = r->arg;
+
+  acquire(&j->lock);
+  if(r->status)
+    j->err = 1;
+  r->next = j->free;
+  j->free = r;
+  j->ndone++;
+  wakeup(j);
+  release(&j->lock);
+}
+
+static void
+runblkjob(struct blkjob *j)
+{
+  struct blkbench *b = j->b;
+  struct blkreq *batch[BLKMAXQD], *r;
+  uint64 nblocks, block;
+  int i, n, nsub;
+
+  nblocks = blksects / (b->len / BLKSECT);
+
+  j->free = 0;
+  j->ndone = 0;
+  j->err = 0;
+  for(i = 0; i < b->qd; i++){
+    r = &j->reqs[i];
+    if((r->seg[0].addr = kalloc()) == 0)
+      panic("blkbench");
+    r->seg[0].len = b->len;
+    r->nseg = 1;
+    r->write = b->write;
+    r->done = blkdone;
+    r->arg = j;
+    r->next = j->free;
+    j->free = r;
+  }
+
+  // as requests complete, refill the queue with
+  // however many came back, in one submission.
+  block = 0;
+  for(nsub = 0; nsub < BLKNREQ; nsub += n){
+    acquire(&j->lock);
+    while(j->free == 0)
+      sleep(j, &j->lock);
+    for(n = 0; j->free && nsub + n < BLKNREQ; n++){
+      batch[n] = j->free;
+      j->free = j->free->next;
+    }
+    release(&j->lock);
+
+    for(i = 0; i < n; i++){
+      if(b->random){
+        j->seed = j->seed * 6364136223846793005UL + 1442695040888963407UL;
+        block = (j->seed >> 33) % nblocks;
+      } else
+        block = (block + 1) % nblocks;
+      batch[i]->sector = blkbase + block * (b->len / BLKSECT);
+    }
+    virtio_disk_submit(batch, n);
+  }
+  acquire(&j->lock);
+  while(j->ndone < BLKNREQ)
+    sleep(j, &j->lock);
+  release(&j->lock);
+
+  for(i = 0; i < b->qd; i++)
+    kfree(j->reqs[i].seg[0].addr);
+}
+
+// print how many notifies and interrupts the disk needed per
+// 1000 I/Os since virtio_disk_stats() filled in s.
+static void
+blkstats(uint64 *s)
+{
+  uint64 nio, nkick, nintr;
+
+  virtio_disk_stats(&nio, &nkick, &nintr);
+  nio -= s[0];
+  if(nio == 0)
+    return;
+  printf("blkbench:   per 1000 I/Os: %d notifies, %d interrupts\n",
+         (int)((nkick - s[1]) * 1000 / nio), (int)((nintr - s[2]) * 1000 / nio));
+}
+
+static void
+runblkbench(struct blkbench *b)
+{
+  struct blkjob *j = &blkjobs[0];
+  uint64 start, t, s[3];
+
+  if(blksects < PGSIZE / BLKSECT){
+    printf("blkbench: no scratch space on disk\n");
+    return;
+  }
+
+  j->b = b;
+  j->seed = 1;
+  virtio_disk_stats(&s[0], &s[1], &s[2]);
+  start = r_time();
+  runblkjob(j);
+  t = r_time() - start;
+
+  if(j->err)
+    printf("blkbench: %s: I/O error\n", b->what);
+  else
+    printf("blkbench: %s, %d bytes, depth %d: %d IOPS, %d KB/s\n", b->what,
+           b->len, b->qd, (int)(BLKNREQ * CLINT_FREQ / t),
+           (int)((uint64)BLKNREQ * b->len / 1024 * CLINT_FREQ / t));
+  blkstats(s);
+}
+
+static void
+blkjobthread(void *arg)
+{
+  runblkjob(arg);
+
+  acquire(&blkscale.lock);
+  blkscale.running--;
+  wakeup(&blkscale);
+  release(&blkscale.lock);
+}
+
+// run blkscalebench on the first nharts harts that are up,
+// each with its own queue depth's worth of requests.
+static void
+runblkscale(int nharts)
+{
+  struct blkbench *b = &blkscalebench;
+  uint64 start, t, s[3];
+  uint online;
+  int hart, n, err;
+
+  online = irq_online();
+  virtio_disk_stats(&s[0], &s[1], &s[2]);
+  blkscale.running = nharts;
+  start = r_time();
+  n = 0;
+  for(hart = 0; hart < NCPU && n < nharts; hart++){
+    if((online & (1 << hart)) == 0)
+      continue;
+    blkjobs[n].b = b;
+    blkjobs[n].seed = n + 1;
+    if(kthread_create(blkjobthread, &blkjobs[n], "blkbench", hart) == 0)
+      panic("runblkscale");
+    n++;
+  }
+  acquire(&blkscale.lock);
+  while(blkscale.running > 0)
+    sleep(&blkscale, &blkscale.lock);
+  release(&blkscale.lock);
+  t = r_time() - start;
+
+  err = 0;
+  for(n = 0; n < nharts; n++)
+    err |= blkjobs[n].err;
+  if(err)
+    printf("blkbench: %s, %d harts: I/O error\n", b->what, nharts);
+  else
+    printf("blkbench: %s, depth %d, %d harts: %d IOPS\n", b->what, b->qd,
+           nharts, (int)(nharts * BLKNREQ * CLINT_FREQ / t));
+  blkstats(s);
+}
+
+// read n blocks of the file system through the buffer cache,
+// twice: the first pass misses, and the second hits as far
+// as the cache holds them.
+static void
+runbcachebench(int n)
+{
+  uint64 hit, miss, evict, h, m, e, start, t;
+  struct buf *bp;
+  int pass, i;
+
+  if(n > sb.size)
+    n = sb.size;
+  for(pass = 0; pass < 2; pass++){
+    bcachestats(&hit, &miss, &evict);
+    start = r_cycle();
+    for(i = 0; i < n; i++){
+      bp = bread(ROOTDEV, i);
+      brelse(bp);
+    }
+    t = r_cycle() - start;
+    bcachestats(&h, &m, &e);
+    printf("bcachebench: %d blocks, pass %d: %d hits %d misses %d evictions, %d cycles per bread\n",
+           n, pass + 1, (int)(h - hit), (int)(m - miss), (int)(e - evict),
+           (int)(t / n));
+  }
+}
+
+// read /bigfile from start to end, len bytes at a time, from
+// the disk rather than the cache, with readahead on or off,
+// the way fileread() does.
+static void
+runreadahead(int on, int len)
+{
+  uint64 hit, miss, evict, h, m, e, start, t;
+  struct readahead ra;
+  struct inode *ip;
+  char *buf;
+  uint off;
+  int n;
+
+  begin_op();
+  ip = namei("/bigfile");
+  end_op();
+  if(ip == 0){
+    printf("rabench: no /bigfile\n");
+    return;
+  }
+  if((buf = kalloc()) == 0)
+    panic("rabench");
+  fs_readahead = on;
+  ra.next = ra.start = ra.size = 0;
+  ilock(ip);
+  binval(ROOTDEV);
+  bcachestats(&hit, &miss, &evict);
+  start = r_time();
+  for(off = 0; off < ip->size; off += n){
+    ireadahead(ip, &ra, off, len);
+    if((n = readi(ip, 0, (uint64)buf, off, len)) <= 0)
+      break;
+  }
+  t = r_time() - start;
+  bcachestats(&h, &m, &e);
+  printf("rabench: %d KB, %d-byte reads, readahead %s: %d KB/s, %d cache misses\n",
+         ip->size / 1024, len, on ? "on" : "off",
+         (int)((uint64)off / 1024 * CLINT_FREQ / t), (int)(m - miss));
+  iunlock(ip);
+  begin_op();
+  iput(ip);
+  end_op();
+  fs_readahead = 1;
+  kfree(buf);
+}
+
+// the log benchmark: threads that each make LOGOPS one-block
+// writes to blocks of their own in /bigfile, each write an FS
+// operation of its own, with or without an fsync after it.
+#define LOGOPS 200
+
+static struct {
+  struct spinlock lock;
+  struct inode *ip;
+  int sync;
+  int running;
+} logjob;
+
+static void
+logjobthread(void *arg)
+{
+  struct inode *ip = logjob.ip;
+  int id = (int)(uint64)arg;
+  uint nblocks, off;
+  char *buf;
+  int i;
+
+  if((buf = kalloc()) == 0)
+    panic("logbench");
+  memset(buf, id, BSIZE);
+  nblocks = ip->size / BSIZE;
+  for(i = 0; i < LOGOPS; i++){
+    off = ((id * 8 + i % 8) % nblocks) * BSIZE;
+    begin_op();
+    ilock(ip);
+    if(writei(ip, 0, (uint64)buf, off, BSIZE) != BSIZE)
+      panic("logbench: writei");
+    iunlock(ip);
+    end_op();
+    if(logjob.sync)
+      log_force();
+  }
+  log_force();
+  kfree(buf);
+
+  acquire(&logjob.lock);
+  logjob.running--;
+  wakeup(&logjob);
+  release(&logjob.lock);
+}
+
+static void
+runlogbench(int nthreads, int sync)
+{
+  uint64 c0, b0, o0, a0, c, b, o, a, start, t;
+  int i;
+
+  begin_op();
+  logjob.ip = namei("/bigfile");
+  end_op();
+  if(logjob.ip == 0){
+    printf("logbench: no /bigfile\n");
+    return;
+  }
+  ilock(logjob.ip);
+  iunlock(logjob.ip);
+  logjob.sync = sync;
+  logjob.running = nthreads;
+  logstats(&c0, &b0, &o0, &a0);
+  start = r_time();
+  for(i = 0; i < nthreads; i++)
+    if(kthread_create(logjobthread, (void*)(uint64)i, "logbench", -1) == 0)
+      panic("runlogbench");
+  acquire(&logjob.lock);
+  while(logjob.running > 0)
+    sleep(&logjob, &logjob.lock);
+  release(&logjob.lock);
+  t = r_time() - start;
+  logstats(&c, &b, &o, &a);
+  c -= c0;
+  if(c == 0)
+    c = 1;
+  printf("logbench: %d threads, %s: %d ops/s, %d commits/s, %d blocks per commit, %d writes absorbed\n",
+         nthreads, sync ? "fsync each" : "no fsync",
+         (int)((o - o0) * CLINT_FREQ / t), (int)(c * CLINT_FREQ / t),
+         (int)((b - b0) / c), (int)(a - a0));
+  begin_op();
+  iput(logjob.ip);
+  end_op();
+}
+
+// the directory benchmark: link DIRFILES names to /README in
+// dir, look each up, and unlink them, timing each step. in
+// "/", which mkfs indexes, and in a directory made here,
+// which is searched from start to end.
+#define DIRFILES 400
+
+// dir/f<i> in path.
+static void
+dirbenchname(char *path, char *dir, int i)
+{
+  char num[8];
+  int n, len;
+
+  n = 0;
+  do {
+    num[n++] = '0' + i % 10;
+    i /= 10;
+  } while(i > 0);
+  len = strlen(dir);
+  memmove(path, dir, len);
+  path[len++] = '/';
+  path[len++] = 'f';
+  while(n > 0)
+    path[len++] = num[--n];
+  path[len] = 0;
+}
+
+// the inode number path names, or 0.
+static uint
+dirbenchinum(char *path)
+{
+  struct inode *ip;
+  uint inum;
+
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
+    return 0;
+  }
+  inum = ip->inum;
+  iput(ip);
+  end_op();
+  return inum;
+}
+
+// check that dir's "." and ".." (dir is "/" or in it) name
+// the right directories, and can't be made again.
+static void
+dirbenchdots(char *dir)
+{
+  char path[MAXPATH];
+  int len;
+
+  len = strlen(dir);
+  memmove(path, dir, len);
+  safestrcpy(path + len, "/.", sizeof(path) - len);
+  if(dirbenchinum(path) != dirbenchinum(len ? dir : "/"))
+    panic("dirbench: .");
+  if(linkpath("/README", path) == 0)
+    panic("dirbench: made .");
+  safestrcpy(path + len, "/..", sizeof(path) - len);
+  if(dirbenchinum(path) != ROOTINO)
+    panic("dirbench: ..");
+  if(linkpath("/README", path) == 0)
+    panic("dirbench: made ..");
+}
+
+static void
+rundirbench(char *dir)
+{
+  uint64 start, tlink, tlook, tunlink;
+  char path[MAXPATH];
+  struct inode *ip;
+  int i;
+
+  dirbenchdots(dir);
+
+  start = r_cycle();
+  for(i = 0; i < DIRFILES; i++){
+    dirbenchname(path, dir, i);
+    if(linkpath("/README", path) < 0)
+      panic("dirbench: link");
+  }
+  tlink = r_cycle() - start;
+
+  start = r_cycle();
+  for(i = 0; i < DIRFILES; i++){
+    dirbenchname(path, dir, i);
+    begin_op();
+    if((ip = namei(path)) == 0)
+      panic("dirbench: namei");
+    iput(ip);
+    end_op();
+  }
+  tlook = r_cycle() - start;
+
+  start = r_cycle();
+  for(i = 0; i < DIRFILES; i++){
+    dirbenchname(path, dir, i);
+    if(unlinkpath(path) < 0)
+      panic("dirbench: unlink");
+  }
+  tunlink = r_cycle() - start;
+
+  printf("dirbench: %d names in %s: %d cycles/link, %d cycles/lookup, %d cycles/unlink\n",
+         DIRFILES, dir[0] ? dir : "/",
+         (int)(tlink / DIRFILES), (int)(tlook / DIRFILES), (int)(tunlink / DIRFILES));
+}
+
+static void
+benchthread(void *arg)
+{
+  struct bench *b;
+  struct blkbench *bb;
+  uint online;
+  int i, nharts;
+
+  for(b = benches; b < &benches[NELEM(benches)]; b++)
+    runbench(b);
+  runbcachebench(NBUF / 2);
+  runbcachebench(2 * NBUF);
+  runreadahead(0, BSIZE);
+  runreadahead(1, BSIZE);
+  runreadahead(0, PGSIZE);
+  runreadahead(1, PGSIZE);
+  initlock(&logjob.lock, "logbench");
+  for(i = 1; i <= 4; i *= 2){
+    runlogbench(i, 1);
+    runlogbench(i, 0);
+  }
+  rundirbench("");
+  if(mkdirpath("/lin") == 0)
+    rundirbench("/lin");
+  for(i = 0; i < NCPU; i++)
+    initlock(&blkjobs[i].lock, "blkbench");
+  initlock(&blkscale.lock, "blkscale");
+  blkbase = (uint64)sb.size * (BSIZE / BLKSECT);
+  if(virtio_disk_capacity() > blkbase)
+    blksects = virtio_disk_capacity() - blkbase;
+  for(bb = blkbenches; bb < &blkbenches[NELEM(blkbenches)]; bb++)
+    runblkbench(bb);
+  if(blksects >= PGSIZE / BLKSECT){
+    nharts = 0;
+    for(online = irq_online(); online; online >>= 1)
+      nharts += online & 1;
+    for(i = 1; i <= nharts; i++)
+      runblkscale(i);
+  }
+  syscalldump();
+}
+
+void
+benchinit(void)
+{
+  if(kthread_create(benchthread, 0, "bench", -1) == 0)
+    panic("benchinit");
+}
@@ -0,0 +1,512 @@
+// Buffer cache.
+//
+// The buffer cache holds cached copies of disk block contents
+// in struct bufs. Caching disk blocks in memory reduces the
+// number of disk reads and also provides a synchronization
+// point for disk blocks used by multiple processes.
+//
+// Interface:
+// * To get a buffer for a particular disk block, call bread.
+// * After changing buffer data, call bwrite to write it to disk
+//   now, or bdirty to have it written back later by bflush.
+// * When done with the buffer, call brelse.
+// * Do not use the buffer after calling brelse.
+// * Only one process at a time can use a buffer,
+//     so do not keep them longer than necessary.
+// * bpin keeps a buffer in the cache without holding it.
+// * bprefetch starts reading blocks that will be wanted soon.
+//
+// Buffers are found by hashing (dev, blockno) into one of
+// NBUCKET buckets, each with its own lock, so lookups of
+// different blocks don't contend. A miss takes evict_lock,
+// which keeps two misses for one block from both loading it,
+// and picks a victim with the CLOCK algorithm: the hand
+// sweeps the buffers, passing over ones that are held,
+// pinned or dirty, and giving ones used since its last pass
+// a second chance.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "blk.h"
+#include "buf.h"
+
+#define NBUCKET 31
+#define BFLUSHBATCH 16  // write-backs per submission
+#define NRAREQ 16       // readahead requests in flight
+
+#define HASH(dev, blockno) (((dev) * 31 + (blockno)) % NBUCKET)
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;
+};
+
+struct {
+  struct bucket bucket[NBUCKET];
+  struct buf buf[NBUF];
+
+  // serializes misses, and protects hand and
+  // which bucket each buf is in.
+  struct spinlock evict_lock;
+  int hand;
+} bcache;
+
+// statistics, printed by bcachedump().
+static uint64 nhit, nmiss, nevict, nwriteback, nprefetch;
+
+static void rainit(void);
+
+void
+binit(void)
+{
+  struct buf *b;
+  int i;
+
+  initlock(&bcache.evict_lock, "bcache");
+  for(i = 0; i < NBUCKET; i++){
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
+    bcache.bucket[i].head = 0;
+  }
+  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
+    initsleeplock(&b->lock, "buffer");
+    b->hash = -1;
+  }
+  rainit();
+}
+
+// Look for block blockno on device dev in bucket h,
+// and take a reference to it if it's there.
+static struct buf*
+bfind(int h, uint dev, uint blockno)
+{
+  struct bucket *bk = &bcache.bucket[h];
+  struct buf *b;
+
+  acquire(&bk->lock);
+  for(b = bk->head; b; b = b->hnext){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      b->used = 1;
+      release(&bk->lock);
+      return b;
+    }
+  }
+  release(&bk->lock);
+  return 0;
+}
+
+// Run the clock hand round until it finds a buffer that
+// is neither held, pinned nor dirty, and hasn't been used
+// since the hand last passed it, and take it out of its
+// bucket. Sets *dirty if only dirty buffers stood in the way.
+// Caller holds evict_lock.
+static struct buf*
+bvictim(int *dirty)
+{
+  struct bucket *bk;
+  struct buf *b, **pp;
+  int i;
+
+  *dirty = 0;
+  for(i = 0; i < 2*NBUF; i++){
+    b = &bcache.buf[bcache.hand];
+    bcache.hand = (bcache.hand + 1) % NBUF;
+    if(b->hash < 0)
+      return b;
+    bk = &bcache.bucket[b->hash];
+    acquire(&bk->lock);
+    if(b->refcnt == 0 && b->dirty)
+      *dirty = 1;
+    if(b->refcnt != 0 || b->dirty){
+      release(&bk->lock);
+      continue;
+    }
+    if(b->used){
+      b->used = 0;
+      release(&bk->lock);
+      continue;
+    }
+    for(pp = &bk->head; *pp != b; pp = &(*pp)->hnext)
+      ;
+    *pp = b->hnext;
+    b->hash = -1;
+    release(&bk->lock);
+    __sync_fetch_and_add(&nevict, 1);
+    return b;
+  }
+  return 0;
+}
+
+// Look through buffer cache for block on device dev, and
+// take a reference to it. If it's there, set *hit and return
+// it unlocked. If not, give it a buffer, and return that
+// locked: nobody else can have it yet, so the lock is free.
+// If every buffer is in use, panic, or if mayfail is set,
+// return 0 without waiting for write-backs.
+static struct buf*
+blookup(uint dev, uint blockno, int *hit, int mayfail)
+{
+  struct bucket *bk;
+  struct buf *b;
+  int h, dirty;
+
+  *hit = 1;
+  h = HASH(dev, blockno);
+  if((b = bfind(h, dev, blockno)) != 0)
+    return b;
+
+  acquire(&bcache.evict_lock);
+  for(;;){
+    // another miss may have loaded it meanwhile.
+    if((b = bfind(h, dev, blockno)) != 0){
+      release(&bcache.evict_lock);
+      return b;
+    }
+    if((b = bvictim(&dirty)) != 0)
+      break;
+    if(mayfail){
+      release(&bcache.evict_lock);
+      return 0;
+    }
+    if(!dirty)
+      panic("bget: no buffers");
+    // write back what's blocking eviction, and try again.
+    release(&bcache.evict_lock);
+    bflush(0);
+    acquire(&bcache.evict_lock);
+  }
+  *hit = 0;
+  acquiresleep(&b->lock);
+
+  bk = &bcache.bucket[h];
+  acquire(&bk->lock);
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->dirty = 0;
+  b->refcnt = 1;
+  b->used = 1;
+  b->hash = h;
+  b->hnext = bk->head;
+  bk->head = b;
+  release(&bk->lock);
+  release(&bcache.evict_lock);
+  return b;
+}
+
+// Return the locked buffer for block on device dev.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct buf *b;
+  int hit;
+
+  b = blookup(dev, blockno, &hit, 0);
+  if(hit){
+    __sync_fetch_and_add(&nhit, 1);
+    acquiresleep(&b->lock);
+  } else
+    __sync_fetch_and_add(&nmiss, 1);
+  return b;
+}
+
+// describe a transfer of b's block in b->req.
+static struct blkreq*
+breq(struct buf *b, int write)
+{
+  struct blkreq *r = &b->req;
+
+  r->write = write;
+  r->sector = (uint64)b->blockno * (BSIZE / BLKSECT);
+  r->nseg = 1;
+  r->seg[0].addr = b->data;
+  r->seg[0].len = BSIZE;
+  r->done = 0;
+  return r;
+}
+
+// Return a locked buf with the contents of the indicated block.
+struct buf*
+bread(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  if(!b->valid) {
+    if(virtio_disk_rw(breq(b, 0)) < 0)
+      panic("bread");
+    b->valid = 1;
+  }
+  return b;
+}
+
+// Write b's contents to disk.  Must be locked.
+void
+bwrite(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwrite");
+  if(virtio_disk_rw(breq(b, 1)) < 0)
+    panic("bwrite");
+  b->dirty = 0;
+}
+
+// Mark b, which must be locked, to be written back
+// by a later bflush() instead of now.
+void
+bdirty(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bdirty");
+  b->dirty = 1;
+}
+
+// Release a locked buffer.
+void
+brelse(struct buf *b)
+{
+  struct bucket *bk;
+
+  if(!holdingsleep(&b->lock))
+    panic("brelse");
+
+  releasesleep(&b->lock);
+
+  bk = &bcache.bucket[b->hash];
+  acquire(&bk->lock);
+  b->refcnt--;
+  release(&bk->lock);
+}
+
+// Keep b in the cache, though nobody holds it.
+void
+bpin(struct buf *b)
+{
+  struct bucket *bk = &bcache.bucket[b->hash];
+
+  acquire(&bk->lock);
+  b->refcnt++;
+  release(&bk->lock);
+}
+
+void
+bunpin(struct buf *b)
+{
+  struct bucket *bk = &bcache.bucket[b->hash];
+
+  acquire(&bk->lock);
+  b->refcnt--;
+  release(&bk->lock);
+}
+
+// Write back dirty buffers, in batches of requests.
+// If all is 0, only the ones nobody holds or has pinned,
+// which can't be in the middle of a change; otherwise
+// every one, waiting for its holder to release it, so
+// the caller must not hold any buffers.
+void
+bflush(int all)
+{
+  struct blkreq *reqs[BFLUSHBATCH];
+  struct buf *b, *list[BFLUSHBATCH];
+  struct bucket *bk;
+  int i, n, h;
+
+  b = bcache.buf;
+  while(b < bcache.buf+NBUF){
+    // take a reference to each, so that none
+    // is evicted or reused while we wait.
+    for(n = 0; n < BFLUSHBATCH && b < bcache.buf+NBUF; b++){
+      if((h = b->hash) < 0)
+        continue;
+      bk = &bcache.bucket[h];
+      acquire(&bk->lock);
+      if(b->hash == h && b->dirty && (all || b->refcnt == 0)){
+        b->refcnt++;
+        list[n++] = b;
+      }
+      release(&bk->lock);
+    }
+    if(n == 0)
+      break;
+
+    for(i = 0; i < n; i++){
+      acquiresleep(&list[i]->lock);
+      reqs[i] = breq(list[i], 1);
+    }
+    virtio_disk_submit(reqs, n);
+    for(i = 0; i < n; i++){
+      if(blk_wait(&list[i]->req) < 0)
+        panic("bflush");
+      list[i]->dirty = 0;
+      brelse(list[i]);
+    }
+    __sync_fetch_and_add(&nwriteback, n);
+  }
+}
+
+// Readahead: bprefetch() gives the blocks it's asked for that
+// aren't cached a buffer each, locked, and reads runs of them
+// that are next to each other on disk with one request each,
+// all in one submission. it doesn't wait: the requests' done
+// function marks each buffer valid and unlocks it, so bread()
+// of one of them waits for just that block to arrive.
+
+// a readahead request, and the buffers it reads into.
+struct rareq {
+  struct blkreq req;
+  struct buf *bufs[BLKMAXSEG];
+  struct rareq *next;  // on the free list
+};
+
+static struct {
+  struct spinlock lock;
+  struct rareq req[NRAREQ];
+  struct rareq *free;
+} rapool;
+
+static void
+rainit(void)
+{
+  int i;
+
+  initlock(&rapool.lock, "readahead");
+  for(i = 0; i < NRAREQ; i++){
+    rapool.req[i].next = rapool.free;
+    rapool.free = &rapool.req[i];
+  }
+}
+
+// called from the disk softirq when a readahead request
+// completes. a buffer that failed stays invalid, and
+// bread() tries it again.
+static void
+radone(struct blkreq *r)
+{
+  struct rareq *ra = (struct rareq*)r;
+  struct bucket *bk;
+  struct buf *b;
+  int i;
+
+  for(i = 0; i < r->nseg; i++){
+    b = ra->bufs[i];
+    b->valid = r->status == 0;
+    releasesleep(&b->lock);
+    bk = &bcache.bucket[b->hash];
+    acquire(&bk->lock);
+    b->refcnt--;
+    release(&bk->lock);
+  }
+
+  acquire(&rapool.lock);
+  ra->next = rapool.free;
+  rapool.free = ra;
+  release(&rapool.lock);
+}
+
+// start reading the n blocks of device dev in blocks into
+// the cache, and return without waiting. best effort: stops
+// early if it runs out of readahead requests, or of buffers
+// it can take without waiting.
+void
+bprefetch(uint dev, uint *blocks, int n)
+{
+  struct blkreq *reqs[NRAREQ];
+  struct rareq *ra;
+  struct buf *b;
+  int i, nreq, hit;
+
+  ra = 0;
+  nreq = 0;
+  for(i = 0; i < n; i++){
+    if((b = blookup(dev, blocks[i], &hit, 1)) == 0)
+      break;
+    if(hit){
+      bunpin(b);
+      continue;
+    }
+    // start a new request unless this block follows the
+    // last one on disk and there's room for it.
+    if(ra == 0 || ra->req.nseg == BLKMAXSEG ||
+       ra->bufs[ra->req.nseg-1]->blockno + 1 != b->blockno){
+      acquire(&rapool.lock);
+      if((ra = rapool.free) != 0)
+        rapool.free = ra->next;
+      release(&rapool.lock);
+      if(ra == 0){
+        brelse(b);
+        break;
+      }
+      ra->req.write = 0;
+      ra->req.sector = (uint64)b->blockno * (BSIZE / BLKSECT);
+      ra->req.nseg = 0;
+      ra->req.done = radone;
+      reqs[nreq++] = &ra->req;
+    }
+    ra->bufs[ra->req.nseg] = b;
+    ra->req.seg[ra->req.nseg].addr = b->data;
+    ra->req.seg[ra->req.nseg].len = BSIZE;
+    ra->req.nseg++;
+    __sync_fetch_and_add(&nprefetch, 1);
+  }
+  if(nreq > 0)
+    virtio_disk_submit(reqs, nreq);
+}
+
+// Forget the blocks of device dev that are cached, clean and
+// not held, so they're read from the disk next time.
+void
+binval(uint dev)
+{
+  struct bucket *bk;
+  struct buf *b, **pp;
+
+  acquire(&bcache.evict_lock);
+  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
+    if(b->hash < 0 || b->dev != dev)
+      continue;
+    bk = &bcache.bucket[b->hash];
+    acquire(&bk->lock);
+    if(b->refcnt == 0 && !b->dirty){
+      for(pp = &bk->head; *pp != b; pp = &(*pp)->hnext)
+        ;
+      *pp = b->hnext;
+      b->hash = -1;
+    }
+    release(&bk->lock);
+  }
+  release(&bcache.evict_lock);
+}
+
+// print buffer cache statistics.
+// runs when user types ^B on console.
+void
+bcachedump(void)
+{
+  struct buf *b;
+  int inuse, dirty;
+
+  inuse = dirty = 0;
+  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
+    if(b->refcnt)
+      inuse++;
+    if(b->dirty)
+      dirty++;
+  }
+  printf("\nbcache: %d hits %d misses %d evictions %d written back %d read ahead; %d of %d bufs held, %d dirty\n",
+         (int)nhit, (int)nmiss, (int)nevict, (int)nwriteback, (int)nprefetch, inuse, NBUF, dirty);
+}
+
+// hits, misses and evictions since boot.
+void
+bcachestats(uint64 *hit, uint64 *miss, uint64 *evict)
+{
+  *hit = nhit;
+  *miss = nmiss;
+  *evict = nevict;
+}
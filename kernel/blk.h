@@ -0,0 +1,32 @@
+// A block I/O request: a scatter-gather list of kernel
+// buffers to read from or write to consecutive 512-byte
+// sectors. see virtio_disk.c.
+#define BLKSECT   512
+#define BLKMAXSEG 16   // segments per request
+#define BLKFLUSH  2    // write: flush the disk's write cache
+
+struct blkseg {
+  void *addr;          // kernel address, physically contiguous
+                       // (kalloc() or static; not a kernel stack)
+  uint len;            // a multiple of BLKSECT
+};
+
+struct blkreq {
+  int write;           // 1 writes the disk, 0 reads it,
+                       // BLKFLUSH flushes it (no segments)
+  uint64 sector;       // first sector
+  int nseg;
+  struct blkseg seg[BLKMAXSEG];
+
+  // called when the request completes, from the disk softirq
+  // or disk worker of the hart that owns its queue, so it must
+  // not sleep. if 0, use blk_wait() instead.
+  void (*done)(struct blkreq*);
+  void *arg;           // for done
+
+  // set by the driver.
+  int status;          // 0, or -EIO
+  int complete;
+  int queue;           // the virtqueue it went to
+  struct blkreq *next; // on the driver's list of completions
+};
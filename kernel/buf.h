@@ -0,0 +1,14 @@
+struct buf {
+  int valid;   // has data been read from disk?
+  int dirty;   // changed since it was last written to disk?
+  uint dev;
+  uint blockno;
+  struct sleeplock lock;
+  // the bucket's lock must be held when using these:
+  uint refcnt;          // holders, and pins; 0 if evictable
+  struct buf *hnext;    // next in the hash bucket
+  int hash;             // bucket, or -1 if in none
+  int used;    // referenced since the clock hand last passed
+  struct blkreq req;    // for write-back
+  uchar data[BSIZE];
+};
@@ -7,6 +7,8 @@
 //   control-u -- kill line
 //   control-d -- end of file
 //   control-p -- print process list
+//   control-t -- print interrupt statistics
+//   control-y -- print system call statistics
 //
 
 #include <stdarg.h>
@@ -19,6 +21,9 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
 
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
@@ -48,11 +53,103 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+
+  struct pollhead poll;  // woken when a line arrives
 } cons;
 
 //
-// the console input interrupt handler.
-// uartintr() calls this for input character.
+// user write()s to the console go here.
+//
+int
+consolewrite(uint64 src, int n)
+{
+  char buf[32];
+  int i, m;
+
+  for(i = 0; i < n; i += m){
+    m = n - i;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(copy_from_user(buf, src + i, m) < 0)
+      break;
+    uartwrite(buf, m);
+  }
+
+  return i;
+}
+
+//
+// user read()s from the console go here.
+// copy (up to) a whole input line to dst.
+//
+int
+consoleread(uint64 dst, int n)
+{
+  uint target;
+  int c;
+  char cbuf;
+
+  target = n;
+  acquire(&cons.lock);
+  while(n > 0){
+    // wait until interrupt handler has put some
+    // input into cons.buffer.
+    while(cons.r == cons.w){
+      if(myproc()->killed){
+        release(&cons.lock);
+        return -1;
+      }
+      sleep(&cons.r, &cons.lock);
+    }
+
+    c = cons.buf[cons.r++ % INPUT_BUF_SIZE];
+
+    if(c == C('D')){  // end-of-file
+      if(n < target){
+        // Save ^D for next time, to make sure
+        // caller gets a 0-byte result.
+        cons.r--;
+      }
+      break;
+    }
+
+    // copy the input byte to the user-space buffer.
+    cbuf = c;
+    if(copy_to_user(dst, &cbuf, 1) < 0)
+      break;
+
+    dst++;
+    --n;
+
+    if(c == '\n'){
+      // a whole line has arrived, return to
+      // the user-level read().
+      break;
+    }
+  }
+  release(&cons.lock);
+
+  return target - n;
+}
+
+// the console is always writable, and readable
+// once a whole line has arrived.
+int
+consolepoll(void)
+{
+  int events;
+
+  acquire(&cons.lock);
+  events = EPOLLOUT;
+  if(cons.r != cons.w)
+    events |= EPOLLIN;
+  release(&cons.lock);
+  return events;
+}
+
+//
+// the console input handler.
+// uartsoftirq() calls this for input character.
 // do erase/kill processing, append to cons.buf,
 // wake up consoleread() if a whole line has arrived.
 //
@@ -61,7 +158,50 @@ consoleintr(int c)
 {
   acquire(&cons.lock);
 
-  (void)c;
+  switch(c){
+  case C('T'):  // Print interrupt statistics.
+    intrdump();
+    break;
+  case C('Y'):  // Print system call statistics.
+    syscalldump();
+    break;
+  case C('B'):  // Print buffer cache statistics.
+    bcachedump();
+    break;
+  case C('U'):  // Kill line.
+    while(cons.e != cons.w &&
+          cons.buf[(cons.e-1) % INPUT_BUF_SIZE] != '\n'){
+      cons.e--;
+      consputc(BACKSPACE);
+    }
+    break;
+  case C('H'): // Backspace
+  case '\x7f': // Delete key
+    if(cons.e != cons.w){
+      cons.e--;
+      consputc(BACKSPACE);
+    }
+    break;
+  default:
+    if(c != 0 && cons.e-cons.r < INPUT_BUF_SIZE){
+      c = (c == '\r') ? '\n' : c;
+
+      // echo back to the user.
+      consputc(c);
+
+      // store for consumption by consoleread().
+      cons.buf[cons.e++ % INPUT_BUF_SIZE] = c;
+
+      if(c == '\n' || c == C('D') || cons.e-cons.r == INPUT_BUF_SIZE){
+        // wake up consoleread() if a whole line (or end-of-file)
+        // has arrived, and any eventpoll watching the console.
+        cons.w = cons.e;
+        wakeup(&cons.r);
+        pollwake(&cons.poll, EPOLLIN);
+      }
+    }
+    break;
+  }
   
   release(&cons.lock);
 }
@@ -75,4 +215,8 @@ consoleinit(void)
 
   // connect read and write system calls
   // to consoleread and consolewrite.
+  devsw[CONSOLE].read = consoleread;
+  devsw[CONSOLE].write = consolewrite;
+  devsw[CONSOLE].poll = consolepoll;
+  devsw[CONSOLE].pollhead = &cons.poll;
 }
@@ -1,22 +1,140 @@
+struct buf;
 struct context;
+struct file;
+struct inode;
+struct readahead;
 struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct work;
+struct vdso;
+struct pipe;
+struct pollhead;
+struct timer;
+struct timerfd;
+struct eventpoll;
+struct blkreq;
+struct virtq;
+struct virtq_buf;
+
+// bench.c
+void            benchinit(void);
+
+// bio.c
+void            binit(void);
+struct buf*     bread(uint, uint);
+void            brelse(struct buf*);
+void            bwrite(struct buf*);
+void            bdirty(struct buf*);
+void            bpin(struct buf*);
+void            bunpin(struct buf*);
+void            bflush(int);
+void            bprefetch(uint, uint*, int);
+void            binval(uint);
+void            bcachedump(void);
+void            bcachestats(uint64*, uint64*, uint64*);
 
 // console.c
 void            consoleinit(void);
 void            consoleintr(int);
 void            consputc(int);
 
+// file.c
+struct file*    filealloc(void);
+void            fileclose(struct file*);
+struct file*    filedup(struct file*);
+void            fileinit(void);
+int             fileread(struct file*, uint64, int);
+int             filestat(struct file*, uint64);
+int             filewrite(struct file*, uint64, int);
+int             filesplice(struct file*, uint64, int);
+int             fileconsole(struct proc*);
+int             filepoll(struct file*);
+struct pollhead* filepollhead(struct file*);
+
+// eventpoll.c
+void            pollinit(void);
+void            pollwake(struct pollhead*, int);
+int             epoll_alloc(struct file**);
+void            epoll_free(struct eventpoll*);
+
+// fs.c
+void            fsinit(int);
+void            iinit(void);
+struct inode*   ialloc(uint, short);
+struct inode*   idup(struct inode*);
+void            iupdate(struct inode*);
+void            itrunc(struct inode*);
+void            ilock(struct inode*);
+void            iunlock(struct inode*);
+void            iput(struct inode*);
+void            iunlockput(struct inode*);
+void            stati(struct inode*, struct stat*);
+int             readi(struct inode*, int, uint64, uint, uint);
+int             writei(struct inode*, int, uint64, uint, uint);
+void            ireadahead(struct inode*, struct readahead*, uint, uint);
+int             namecmp(const char*, const char*);
+struct inode*   dirlookup(struct inode*, char*, uint*);
+int             dirlink(struct inode*, char*, uint);
+struct inode*   namei(char*);
+struct inode*   nameiparent(char*, char*);
+
+// log.c
+void            initlog(int, struct superblock*);
+void            log_write(struct buf*);
+void            begin_op(void);
+void            end_op(void);
+void            log_force(void);
+void            logstats(uint64*, uint64*, uint64*, uint64*);
+
+// fpu.c
+int             fpu_trap(struct proc*);
+void            fpu_switchout(struct proc*);
+void            fpu_init(struct proc*);
+
+// futex.c
+void            futexinit(void);
+int             futex_wait(uint64, uint32, uint);
+int             futex_wake(uint64, int);
+void            futex_tick(void);
+
+
+// ipc.c
+void            ipcinit(void);
+void            ipc_exit(struct proc*);
+int             ipc_poll(int);
+struct pollhead* ipc_pollhead(int);
+
+// irq.c
+void            irqinit(void);
+void            irqinithart(void);
+int             irq_set_affinity(int, uint);
+uint            irq_online(void);
+void            irqstat(int, uint64);
+void            irqbalance(void);
+void            intrdump(void);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_contig(int);
 void            kfree(void *);
+void            kref(void *);
+int             krefcount(void *);
 void            kinit(void);
 
 
+// pipe.c
+int             pipealloc(struct file**, struct file**);
+void            pipeclose(struct pipe*, int);
+int             piperead(struct pipe*, uint64, int);
+int             pipewrite(struct pipe*, uint64, int);
+int             pipe_vmsplice_read(struct pipe*, uint64, int);
+int             pipe_vmsplice_write(struct pipe*, uint64, int);
+int             pipepoll(struct pipe*, int);
+struct pollhead* pipepollhead(struct pipe*);
+
 // printf.c
 void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
@@ -24,19 +142,45 @@ void            printfinit(void);
 
 // proc.c
 int             cpuid(void);
+void            exit(int);
+int             growproc(int);
+struct proc*    kthread_create(void (*)(void*), void*, char*, int);
 void            proc_mapstacks(pagetable_t);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            procinit(void);
+pagetable_t     proc_pagetable(struct proc *);
+void            proc_freepagetable(pagetable_t, uint64);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
+void            sleep_handoff(void*, struct spinlock*, struct proc*, void*);
+int             kill(int);
+int             uspawn(char*, uchar*, uint, uint64);
+int             wait(int*);
 void            wakeup(void*);
+void            wakeup_proc(struct proc*, void*);
 void            yield(void);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
 
+// ring.c
+void            ringinit(void);
+void            ring_exit(struct proc*);
+void            ring_free(struct proc*);
+
+// shm.c
+void            shminit(void);
+void            shm_free(struct proc*);
+
+// softirq.c
+void            softirqinit(void);
+void            open_softirq(int, void (*)(void));
+void            raise_softirq(int);
+void            do_softirq(void);
+void            softirqdump(void);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
@@ -60,8 +204,33 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// syscall.c
+void            argint(int, int*);
+void            argaddr(int, uint64 *);
+void            syscall();
+void            syscalldump(void);
+#ifdef SYSCALL_HOOKS
+int             syscall_sethook(int, void (*)(int), void (*)(int, uint64));
+#endif
 
 
+// sysfile.c
+int             fdalloc(struct file*);
+int             linkpath(char*, char*);
+int             unlinkpath(char*);
+int             mkdirpath(char*);
+
+// timer.c
+void            timerinit(void);
+void            add_timer(struct timer*, uint);
+void            del_timer(struct timer*);
+void            timer_tick(void);
+int             timerfd_alloc(struct file**, uint);
+void            timerfd_close(struct timerfd*);
+int             timerfd_read(struct timerfd*, uint64, int);
+int             timerfd_poll(struct timerfd*);
+struct pollhead* timerfd_pollhead(struct timerfd*);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
@@ -74,21 +243,80 @@ void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
 void            uartputc_sync(int);
+void            uartwrite(char*, int);
 int             uartgetc(void);
 
+// workqueue.c
+void            workqueueinit(void);
+void            initwork(struct work*, void (*)(struct work*));
+int             queue_work(struct work*);
+int             queue_work_on(int, struct work*);
+void            flush_work(struct work*);
+
+// uaccess.c
+uint64          uaccess_fixup(uint64);
+int             copy_from_user(void*, uint64, uint64);
+int             copy_to_user(uint64, void*, uint64);
+int             strncpy_from_user(char*, uint64, int);
+
+// vdso.c
+void            vdso_init(struct vdso*, struct proc*);
+void            vdso_sethart(struct proc*);
+
+// virtio.c
+uint64          virtio_negotiate(uint64, int, uint64);
+void            virtio_ready(uint64);
+void            virtq_init(struct virtq*, uint64, int, uint64);
+int             virtq_add(struct virtq*, struct virtq_buf*, int, int, void*);
+int             virtq_kick(struct virtq*);
+int             virtq_pending(struct virtq*);
+void*           virtq_get(struct virtq*, uint32*);
+void            virtq_disable_cb(struct virtq*);
+int             virtq_enable_cb(struct virtq*);
+
+// virtio_disk.c
+void            virtio_disk_init(void);
+uint64          virtio_disk_capacity(void);
+void            virtio_disk_stats(uint64*, uint64*, uint64*);
+void            virtio_disk_submit(struct blkreq**, int);
+int             virtio_disk_rw(struct blkreq*);
+int             blk_wait(struct blkreq*);
+int             virtio_disk_flush(void);
+void            virtio_disk_intr(void);
+
 // vm.c
 void            kvminit(void);
 void            kvminithart(void);
+pagetable_t     kvmcreate(pagetable_t);
+void            kvmfree(pagetable_t);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
+pagetable_t     uvmcreate(void);
+uint64          uvmload(pagetable_t, uchar*, uint);
+uint64          uvmalloc(pagetable_t, uint64, uint64, int);
+uint64          uvmdealloc(pagetable_t, uint64, uint64);
+void            uvmunmap(pagetable_t, uint64, uint64, int);
+void            uvmfree(pagetable_t, uint64);
+int             uvmcow(pagetable_t, uint64);
 
 // plic.c
 void            plicinit(void);
 void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
+void            plic_route(int, uint);
+
+// imsic.c
+void            imsicinit(void);
+void            imsicinithart(void);
+int             imsic_claim(void);
+void            imsic_complete(int);
+void            imsic_route(int, uint);
+int             msi_alloc(int, void (*)(void*), void*, uint64*, uint32*);
+void            msi_free(int, int);
+void            msiintr(int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
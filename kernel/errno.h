@@ -0,0 +1,13 @@
+// Error numbers returned (negated) by system calls
+// that need to say more than -1.
+#define ENOENT      2  // no such entry
+#define EINTR       4  // interrupted by kill
+#define EIO         5  // I/O error
+#define EAGAIN     11  // try again
+#define ENOMEM     12  // out of memory
+#define EFAULT     14  // bad user address
+#define EBUSY      16  // already in use
+#define EEXIST     17  // already exists
+#define EINVAL     22  // invalid argument
+#define EPIPE      32  // the other end went away
+#define ETIMEDOUT 110  // timed out
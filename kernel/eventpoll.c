@@ -0,0 +1,451 @@
+//
+// eventpolls: waiting on many sources of events at once.
+//
+// a process registers interest in file descriptors with
+// epoll_ctl(), and epoll_wait() returns a batch of the ones
+// that are ready. readiness is pushed, not polled: a source
+// calls pollwake() on its pollhead when it becomes ready,
+// which queues each interested epitem on its eventpoll's
+// ready list. epoll_wait() looks only at that list, so its
+// cost depends on how many sources are ready, not on how
+// many are registered.
+//
+// an item stays queued for as long as its source is ready,
+// unless it was registered with EPOLLET, in which case it is
+// reported once per pollwake(). each item holds a reference
+// to its file until it is deleted or the eventpoll is closed.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
+#include "timer.h"
+#include "errno.h"
+#include "defs.h"
+
+#define NEPITEM NOFILE   // registrations per eventpoll
+
+// epitem.ready.
+#define EP_IDLE     0
+#define EP_QUEUED   1    // on the ready list
+#define EP_CHECKING 2    // taken off it by epoll_wait()
+
+struct epitem {
+  struct file *f;          // 0 if the slot is free
+  int fd;
+  uint events;             // what to report, and EPOLLET
+  uint64 data;
+  struct eventpoll *ep;
+  struct pollhead *ph;
+  // poll_lock must be held when using these:
+  struct epitem *hnext;    // on ph's list
+  struct epitem *rdnext;   // on ep's ready list
+  int ready;
+  int again;               // pollwake()n while EP_CHECKING
+};
+
+struct eventpoll {
+  // serializes epoll_ctl() and epoll_wait()'s
+  // scan of the ready list, and protects items.
+  struct sleeplock mu;
+  struct epitem items[NEPITEM];
+
+  // poll_lock must be held when using these:
+  struct epitem *rdlist;
+  struct epitem **rdtail;
+  int nwait;               // processes in epoll_wait()
+};
+
+// protects every pollhead's list and every
+// eventpoll's ready list. sources hold their own
+// lock when they take this one.
+static struct spinlock poll_lock;
+
+void
+pollinit(void)
+{
+  initlock(&poll_lock, "poll");
+}
+
+// caller holds poll_lock.
+static void
+ep_queue(struct epitem *it)
+{
+  struct eventpoll *ep = it->ep;
+
+  it->ready = EP_QUEUED;
+  it->rdnext = 0;
+  *ep->rdtail = it;
+  ep->rdtail = &it->rdnext;
+  if(ep->nwait)
+    wakeup(ep);
+}
+
+// caller holds poll_lock.
+static void
+ep_unqueue(struct epitem *it)
+{
+  struct eventpoll *ep = it->ep;
+  struct epitem **pp;
+
+  for(pp = &ep->rdlist; *pp; pp = &(*pp)->rdnext){
+    if(*pp == it){
+      *pp = it->rdnext;
+      if(ep->rdtail == &it->rdnext)
+        ep->rdtail = pp;
+      break;
+    }
+  }
+  it->ready = EP_IDLE;
+}
+
+// called by a source, with its lock held, when it becomes
+// ready for events.
+void
+pollwake(struct pollhead *ph, int events)
+{
+  struct epitem *it;
+
+  // the common case: nobody is watching.
+  if(ph->items == 0)
+    return;
+
+  acquire(&poll_lock);
+  for(it = ph->items; it; it = it->hnext){
+    if(((it->events | EPOLLERR | EPOLLHUP) & events) == 0)
+      continue;
+    if(it->ready == EP_IDLE)
+      ep_queue(it);
+    else if(it->ready == EP_CHECKING)
+      it->again = 1;
+  }
+  release(&poll_lock);
+}
+
+int
+epoll_alloc(struct file **fp)
+{
+  struct eventpoll *ep;
+  struct file *f;
+
+  if((f = filealloc()) == 0)
+    return -1;
+  if((ep = (struct eventpoll*)kalloc()) == 0){
+    fileclose(f);
+    return -1;
+  }
+  memset(ep, 0, sizeof(*ep));
+  initsleeplock(&ep->mu, "epoll");
+  ep->rdtail = &ep->rdlist;
+
+  f->type = FD_EPOLL;
+  f->readable = 1;
+  f->writable = 0;
+  f->ep = ep;
+  *fp = f;
+  return 0;
+}
+
+// caller holds ep->mu.
+static void
+ep_remove(struct epitem *it)
+{
+  struct epitem **pp;
+  struct file *f;
+
+  acquire(&poll_lock);
+  for(pp = &it->ph->items; *pp; pp = &(*pp)->hnext){
+    if(*pp == it){
+      *pp = it->hnext;
+      break;
+    }
+  }
+  if(it->ready == EP_QUEUED)
+    ep_unqueue(it);
+  release(&poll_lock);
+
+  f = it->f;
+  it->f = 0;
+  fileclose(f);
+}
+
+void
+epoll_free(struct eventpoll *ep)
+{
+  struct epitem *it;
+
+  acquiresleep(&ep->mu);
+  for(it = ep->items; it < &ep->items[NEPITEM]; it++)
+    if(it->f)
+      ep_remove(it);
+  releasesleep(&ep->mu);
+  kfree((char*)ep);
+}
+
+// queue it if its source is already ready. caller holds
+// ep->mu, and it is on its pollhead's list, so that a
+// pollwake() after the check below can't be missed.
+static void
+ep_check(struct epitem *it)
+{
+  int events;
+
+  events = filepoll(it->f);
+  if((events & (it->events | EPOLLERR | EPOLLHUP)) == 0)
+    return;
+  acquire(&poll_lock);
+  if(it->ready == EP_IDLE)
+    ep_queue(it);
+  release(&poll_lock);
+}
+
+static int
+epoll_ctl(struct eventpoll *ep, int op, int fd, struct file *f, struct epoll_event *ev)
+{
+  struct epitem *it, *free;
+  struct pollhead *ph;
+
+  acquiresleep(&ep->mu);
+  free = 0;
+  for(it = ep->items; it < &ep->items[NEPITEM]; it++){
+    if(it->f == 0 && free == 0)
+      free = it;
+    if(it->f && it->fd == fd && it->f == f)
+      break;
+  }
+  if(it == &ep->items[NEPITEM])
+    it = 0;
+
+  switch(op){
+  case EPOLL_CTL_ADD:
+    if(it){
+      releasesleep(&ep->mu);
+      return -EEXIST;
+    }
+    if(free == 0 || (ph = filepollhead(f)) == 0){
+      releasesleep(&ep->mu);
+      return free ? -EINVAL : -ENOMEM;
+    }
+    it = free;
+    it->f = filedup(f);
+    it->fd = fd;
+    it->events = ev->events;
+    it->data = ev->data;
+    it->ep = ep;
+    it->ph = ph;
+    acquire(&poll_lock);
+    it->ready = EP_IDLE;
+    it->hnext = ph->items;
+    ph->items = it;
+    release(&poll_lock);
+    ep_check(it);
+    break;
+
+  case EPOLL_CTL_MOD:
+    if(it == 0){
+      releasesleep(&ep->mu);
+      return -ENOENT;
+    }
+    acquire(&poll_lock);
+    it->events = ev->events;
+    it->data = ev->data;
+    release(&poll_lock);
+    ep_check(it);
+    break;
+
+  case EPOLL_CTL_DEL:
+    if(it == 0){
+      releasesleep(&ep->mu);
+      return -ENOENT;
+    }
+    ep_remove(it);
+    break;
+
+  default:
+    releasesleep(&ep->mu);
+    return -EINVAL;
+  }
+
+  releasesleep(&ep->mu);
+  return 0;
+}
+
+// report up to max of the queued items that are still ready
+// to the epoll_event array at addr. returns the number
+// reported, which may be 0, or -EFAULT.
+static int
+ep_scan(struct eventpoll *ep, uint64 addr, int max)
+{
+  struct epitem *it, *next, *list;
+  struct epoll_event ev;
+  int n, err, looked;
+
+  acquiresleep(&ep->mu);
+
+  acquire(&poll_lock);
+  list = ep->rdlist;
+  ep->rdlist = 0;
+  ep->rdtail = &ep->rdlist;
+  for(it = list; it; it = it->rdnext){
+    it->ready = EP_CHECKING;
+    it->again = 0;
+  }
+  release(&poll_lock);
+
+  n = 0;
+  err = 0;
+  for(it = list; it; it = next){
+    next = it->rdnext;
+    ev.events = 0;
+    looked = n < max && !err;
+    if(looked){
+      ev.events = filepoll(it->f) & (it->events | EPOLLERR | EPOLLHUP);
+      ev.pad = 0;
+      ev.data = it->data;
+      if(ev.events && copy_to_user(addr + n*sizeof(ev), &ev, sizeof(ev)) < 0){
+        err = -EFAULT;
+        ev.events = 0;
+      } else if(ev.events)
+        n++;
+    }
+
+    // requeue what is still ready, or wasn't looked at.
+    acquire(&poll_lock);
+    if(!looked || it->again || (ev.events && !(it->events & EPOLLET)))
+      ep_queue(it);
+    else
+      it->ready = EP_IDLE;
+    release(&poll_lock);
+  }
+
+  releasesleep(&ep->mu);
+  return n > 0 ? n : err;
+}
+
+// a waiter in epoll_wait() with a timeout.
+struct ep_waiter {
+  struct timer timer;
+  struct eventpoll *ep;
+  int timedout;            // poll_lock
+};
+
+static void
+ep_timeout(struct timer *t)
+{
+  struct ep_waiter *w = t->arg;
+
+  acquire(&poll_lock);
+  w->timedout = 1;
+  wakeup(w->ep);
+  release(&poll_lock);
+}
+
+// wait up to timeout ticks, or forever if timeout is
+// negative, for some of ep's items to be ready, and copy
+// up to max of them to addr. returns the number copied,
+// 0 on timeout, or -EINTR or -EFAULT.
+static int
+epoll_wait(struct eventpoll *ep, uint64 addr, int max, int timeout)
+{
+  struct proc *p = myproc();
+  struct ep_waiter w;
+  int n;
+
+  w.ep = ep;
+  w.timedout = timeout == 0;
+  w.timer.fn = ep_timeout;
+  w.timer.arg = &w;
+  w.timer.interval = 0;
+  w.timer.armed = 0;
+  if(timeout > 0)
+    add_timer(&w.timer, timeout);
+
+  for(;;){
+    acquire(&poll_lock);
+    while(ep->rdlist == 0){
+      if(w.timedout || p->killed){
+        n = w.timedout ? 0 : -EINTR;
+        release(&poll_lock);
+        goto out;
+      }
+      ep->nwait++;
+      sleep(ep, &poll_lock);
+      ep->nwait--;
+    }
+    release(&poll_lock);
+
+    // everything queued may have stopped being
+    // ready since; if so, wait again.
+    if((n = ep_scan(ep, addr, max)) != 0 || w.timedout)
+      break;
+  }
+
+out:
+  if(timeout > 0)
+    del_timer(&w.timer);
+  return n;
+}
+
+uint64
+sys_epoll_create(void)
+{
+  struct file *f;
+  int fd;
+
+  if(epoll_alloc(&f) < 0)
+    return -ENOMEM;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+// epoll_ctl(epfd, op, fd, struct epoll_event *ev)
+uint64
+sys_epoll_ctl(void)
+{
+  struct file *epf, *f;
+  struct epoll_event ev;
+  int epfd, op, fd;
+  uint64 uev;
+
+  argint(0, &epfd);
+  argint(1, &op);
+  argint(2, &fd);
+  argaddr(3, &uev);
+  if(epfd < 0 || epfd >= NOFILE || (epf = myproc()->ofile[epfd]) == 0 ||
+     epf->type != FD_EPOLL)
+    return -EINVAL;
+  if(fd < 0 || fd >= NOFILE || (f = myproc()->ofile[fd]) == 0)
+    return -EINVAL;
+  memset(&ev, 0, sizeof(ev));
+  if(op != EPOLL_CTL_DEL && copy_from_user(&ev, uev, sizeof(ev)) < 0)
+    return -EFAULT;
+  return epoll_ctl(epf->ep, op, fd, f, &ev);
+}
+
+// epoll_wait(epfd, struct epoll_event *events, max, timeout)
+uint64
+sys_epoll_wait(void)
+{
+  struct file *epf;
+  int epfd, max, timeout;
+  uint64 uevents;
+
+  argint(0, &epfd);
+  argaddr(1, &uevents);
+  argint(2, &max);
+  argint(3, &timeout);
+  if(epfd < 0 || epfd >= NOFILE || (epf = myproc()->ofile[epfd]) == 0 ||
+     epf->type != FD_EPOLL || max <= 0)
+    return -EINVAL;
+  return epoll_wait(epf->ep, uevents, max, timeout);
+}
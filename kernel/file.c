@@ -0,0 +1,251 @@
+//
+// Support functions for system calls that involve file descriptors.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "poll.h"
+#include "stat.h"
+
+struct devsw devsw[NDEV];
+
+struct {
+  struct spinlock lock;
+  struct file file[NFILE];
+} ftable;
+
+void
+fileinit(void)
+{
+  initlock(&ftable.lock, "ftable");
+}
+
+// Allocate a file structure.
+struct file*
+filealloc(void)
+{
+  struct file *f;
+
+  acquire(&ftable.lock);
+  for(f = ftable.file; f < ftable.file + NFILE; f++){
+    if(f->ref == 0){
+      f->ref = 1;
+      release(&ftable.lock);
+      return f;
+    }
+  }
+  release(&ftable.lock);
+  return 0;
+}
+
+// Increment ref count for file f.
+struct file*
+filedup(struct file *f)
+{
+  acquire(&ftable.lock);
+  if(f->ref < 1)
+    panic("filedup");
+  f->ref++;
+  release(&ftable.lock);
+  return f;
+}
+
+// Close file f.  (Decrement ref count, close when reaches 0.)
+void
+fileclose(struct file *f)
+{
+  struct file ff;
+
+  acquire(&ftable.lock);
+  if(f->ref < 1)
+    panic("fileclose");
+  if(--f->ref > 0){
+    release(&ftable.lock);
+    return;
+  }
+  ff = *f;
+  f->ref = 0;
+  f->type = FD_NONE;
+  f->ip = 0;
+  release(&ftable.lock);
+
+  if(ff.type == FD_PIPE)
+    pipeclose(ff.pipe, ff.writable);
+  else if(ff.type == FD_TIMER)
+    timerfd_close(ff.timer);
+  else if(ff.type == FD_EPOLL)
+    epoll_free(ff.ep);
+  else if(ff.type == FD_INODE || ff.ip){
+    begin_op();
+    iput(ff.ip);
+    end_op();
+  }
+}
+
+// Give p standard input, output and error on the console.
+// Returns 0, or -1 if out of files.
+int
+fileconsole(struct proc *p)
+{
+  struct file *f;
+  int fd;
+
+  if((f = filealloc()) == 0)
+    return -1;
+  f->type = FD_DEVICE;
+  f->major = CONSOLE;
+  f->readable = 1;
+  f->writable = 1;
+  p->ofile[0] = f;
+  for(fd = 1; fd < 3; fd++)
+    p->ofile[fd] = filedup(f);
+  return 0;
+}
+
+// Get metadata about file f.
+// addr is a user virtual address, pointing to a struct stat.
+int
+filestat(struct file *f, uint64 addr)
+{
+  struct stat st;
+
+  if(f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  stati(f->ip, &st);
+  iunlock(f->ip);
+  if(copy_to_user(addr, &st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
+
+// Read from file f.
+// addr is a user virtual address.
+int
+fileread(struct file *f, uint64 addr, int n)
+{
+  int r;
+
+  if(f->readable == 0)
+    return -1;
+
+  if(f->type == FD_PIPE)
+    return piperead(f->pipe, addr, n);
+  if(f->type == FD_DEVICE){
+    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
+      return -1;
+    return devsw[f->major].read(addr, n);
+  }
+  if(f->type == FD_TIMER)
+    return timerfd_read(f->timer, addr, n);
+  if(f->type == FD_INODE){
+    if(n < 0)
+      return -1;
+    ilock(f->ip);
+    ireadahead(f->ip, &f->ra, f->off, n);
+    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+      f->off += r;
+    iunlock(f->ip);
+    return r;
+  }
+  return -1;
+}
+
+// Write to file f.
+// addr is a user virtual address.
+int
+filewrite(struct file *f, uint64 addr, int n)
+{
+  int r, i, n1, max;
+
+  if(f->writable == 0)
+    return -1;
+
+  if(f->type == FD_PIPE)
+    return pipewrite(f->pipe, addr, n);
+  if(f->type == FD_DEVICE){
+    if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
+      return -1;
+    return devsw[f->major].write(addr, n);
+  }
+  if(f->type == FD_INODE){
+    // write a few blocks at a time to avoid exceeding
+    // the maximum log transaction size, including
+    // i-node, indirect block, allocation blocks,
+    // and 2 blocks of slop for non-aligned writes.
+    max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+    i = 0;
+    while(i < n){
+      n1 = n - i;
+      if(n1 > max)
+        n1 = max;
+
+      begin_op();
+      ilock(f->ip);
+      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
+        f->off += r;
+      iunlock(f->ip);
+      end_op();
+
+      if(r != n1){
+        // error from writei
+        break;
+      }
+      i += r;
+    }
+    return i == n ? n : -1;
+  }
+  return -1;
+}
+
+// Move whole pages between user memory at addr and
+// file f, which must be a pipe; see pipe.c.
+int
+filesplice(struct file *f, uint64 addr, int n)
+{
+  if(f->type != FD_PIPE)
+    return -1;
+
+  if(f->writable)
+    return pipe_vmsplice_write(f->pipe, addr, n);
+  return pipe_vmsplice_read(f->pipe, addr, n);
+}
+
+// The events f is ready for now, for eventpoll.c.
+// Takes the lock of whatever f refers to.
+int
+filepoll(struct file *f)
+{
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable);
+  if(f->type == FD_DEVICE && devsw[f->major].poll)
+    return devsw[f->major].poll();
+  if(f->type == FD_TIMER)
+    return timerfd_poll(f->timer);
+  if(f->type == FD_ENDPOINT)
+    return ipc_poll(f->endpoint);
+  return 0;
+}
+
+// The pollhead that whatever f refers to wakes when it
+// becomes ready, or 0 if it can't be polled.
+struct pollhead*
+filepollhead(struct file *f)
+{
+  if(f->type == FD_PIPE)
+    return pipepollhead(f->pipe);
+  if(f->type == FD_DEVICE)
+    return devsw[f->major].pollhead;
+  if(f->type == FD_TIMER)
+    return timerfd_pollhead(f->timer);
+  if(f->type == FD_ENDPOINT)
+    return ipc_pollhead(f->endpoint);
+  return 0;
+}
@@ -0,0 +1,55 @@
+// a reader's sequential readahead state; see ireadahead() in fs.c.
+struct readahead {
+  uint next;   // the block a sequential reader reads next
+  uint start;  // the window last read ahead
+  uint size;   // in blocks; 0 if none
+};
+
+struct file {
+  enum { FD_NONE, FD_PIPE, FD_DEVICE, FD_TIMER, FD_EPOLL, FD_ENDPOINT, FD_INODE } type;
+  int ref; // reference count
+  char readable;
+  char writable;
+  struct pipe *pipe; // FD_PIPE
+  short major;       // FD_DEVICE
+  struct timerfd *timer;   // FD_TIMER
+  struct eventpoll *ep;    // FD_EPOLL
+  int endpoint;            // FD_ENDPOINT
+  struct inode *ip;        // FD_INODE
+  uint off;                // FD_INODE
+  struct readahead ra;     // FD_INODE
+};
+
+// in-memory copy of an inode
+struct inode {
+  uint dev;           // Device number
+  uint inum;          // Inode number
+  int ref;            // Reference count
+  struct sleeplock lock; // protects everything below here
+  int valid;          // inode has been read from disk?
+
+  short type;         // copy of disk inode
+  short major;
+  short minor;
+  short nlink;
+  uint size;
+  union {
+    uint addrs[NDIRECT+1];
+    struct {
+      struct extent ext[NEXTENT];
+      uint extblock;
+    };
+  };
+};
+
+// map major device number to device functions.
+struct devsw {
+  int (*read)(uint64, int);
+  int (*write)(uint64, int);
+  int (*poll)(void);              // ready events, see poll.h
+  struct pollhead *pollhead;      // woken when they change
+};
+
+extern struct devsw devsw[];
+
+#define CONSOLE 1
@@ -0,0 +1,71 @@
+//
+// lazy floating-point context switching.
+//
+// processes run with sstatus.FS Off, so that the first FP
+// instruction after a process is switched in traps. only then
+// are its FP registers loaded, and only if this hart's registers
+// don't still hold them. at switch-out they are saved only if
+// FS says they have changed. integer-only processes never pay.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+// fpswitch.S
+void fpsave(struct fpstate*);
+void fprestore(struct fpstate*);
+
+static void
+w_fs(uint64 fs)
+{
+  w_sstatus((r_sstatus() & ~SSTATUS_FS) | fs);
+}
+
+// called by usertrap() for an illegal instruction.
+// if FP was Off, the process's first FP instruction
+// since it was switched in caused it: turn FP on and
+// return 1, so the instruction is retried.
+int
+fpu_trap(struct proc *p)
+{
+  struct cpu *c;
+
+  if((r_sstatus() & SSTATUS_FS) != SSTATUS_FS_OFF)
+    return 0;
+
+  push_off();
+  c = mycpu();
+  w_fs(SSTATUS_FS_CLEAN);
+  if(c->fpowner != p || p->fpcpu != cpuid()){
+    fprestore(&p->fp);
+    c->fpowner = p;
+    p->fpcpu = cpuid();
+    w_fs(SSTATUS_FS_CLEAN);
+  }
+  pop_off();
+  return 1;
+}
+
+// called by sched() as p gives up the CPU.
+void
+fpu_switchout(struct proc *p)
+{
+  if((r_sstatus() & SSTATUS_FS) == SSTATUS_FS_DIRTY)
+    fpsave(&p->fp);
+  // the registers still hold p's state, and
+  // mycpu()->fpowner still says so.
+  w_fs(SSTATUS_FS_OFF);
+}
+
+// give a new process zeroed FP state.
+void
+fpu_init(struct proc *p)
+{
+  memset(&p->fp, 0, sizeof(p->fp));
+  p->fpcpu = -1;
+}
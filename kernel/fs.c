@@ -0,0 +1,1166 @@
+// File system implementation.  Five layers:
+//  + Blocks: allocator for raw disk blocks.
+//  + Log: crash recovery for multi-step updates.
+//  + Files: inode allocator, reading, writing, metadata.
+//  + Directories: inode with special contents (list of other inodes!)
+//  + Names: paths like /usr/rtm/xv6/fs.c for convenient naming.
+//
+// This file contains the low-level file system manipulation
+// routines.  The (higher-level) system call implementations
+// are in sysfile.c.
+//
+// A file read sequentially is read ahead, in windows that grow
+// as long as the reader keeps up; see ireadahead().
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "blk.h"
+#include "buf.h"
+#include "file.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+// there should be one superblock per disk device, but we run with
+// only one device
+struct superblock sb; 
+
+// whether files read sequentially are read ahead.
+int fs_readahead = 1;
+
+static void bginit(int);
+
+// Read the super block.
+static void
+readsb(int dev, struct superblock *sb)
+{
+  struct buf *bp;
+
+  bp = bread(dev, 1);
+  memmove(sb, bp->data, sizeof(*sb));
+  brelse(bp);
+}
+
+// Init fs
+void
+fsinit(int dev) {
+  readsb(dev, &sb);
+  if(sb.magic != FSMAGIC)
+    panic("invalid file system");
+  if(sb.version > FSV_EXTENT)
+    panic("fs: unknown version");
+  printf("fs: %d blocks, %d inodes, %d log blocks, %s files\n", sb.size, sb.ninodes,
+         sb.nlog, sb.version == FSV_EXTENT ? "extent" : "classic");
+  initlog(dev, &sb);
+  bginit(dev);
+}
+
+// Zero a block.
+static void
+bzero(int dev, int bno)
+{
+  struct buf *bp;
+
+  bp = bread(dev, bno);
+  memset(bp->data, 0, BSIZE);
+  log_write(bp);
+  brelse(bp);
+}
+
+// Blocks.
+//
+// The blocks the bitmap maps are split into allocation
+// groups, a bitmap block's worth (BPB blocks) each. An
+// in-memory summary of each group, made from the bitmap at
+// boot, has its number of free blocks and a hint, the first
+// of them that might be free, so that allocation passes over
+// full groups, and full stretches of the others, without
+// reading them. Each hart has a preferred group, where it
+// allocates blocks that have no goal, such as the first
+// block of a new file: harts writing new files at once work
+// in different bitmap blocks, and keep their files apart. A
+// hart whose group fills moves on to the one it next
+// allocates from.
+//
+// A group's summary changes only with its bitmap block
+// locked, with the bitmap. Reading it without the lock
+// gives a hint, which the bitmap then settles.
+
+#define NBGROUP 64
+
+static struct bgroup {
+  uint nfree;  // free blocks in the group
+  uint first;  // no block before this one is free (a bit)
+} bgroups[NBGROUP];
+static int nbgroup;
+static int bgpref[NCPU];  // each hart's preferred group
+
+// the number of blocks in group g.
+static uint
+bgsize(int g)
+{
+  return min(BPB, sb.size - g * BPB);
+}
+
+// make the summaries of the allocation groups.
+static void
+bginit(int dev)
+{
+  struct bgroup *g;
+  struct buf *bp;
+  uint bi, n;
+  int i;
+
+  nbgroup = (sb.size + BPB - 1) / BPB;
+  if(nbgroup > NBGROUP)
+    panic("fs: too many allocation groups");
+  for(i = 0; i < nbgroup; i++){
+    g = &bgroups[i];
+    n = bgsize(i);
+    g->nfree = 0;
+    g->first = n;
+    bp = bread(dev, sb.bmapstart + i);
+    for(bi = 0; bi < n; bi++){
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0){
+        if(g->nfree++ == 0)
+          g->first = bi;
+      }
+    }
+    brelse(bp);
+  }
+  for(i = 0; i < NCPU; i++)
+    bgpref[i] = i % nbgroup;
+}
+
+// Allocate up to n zeroed disk blocks, in a row: the first
+// free one from goal on, and as many of the free ones right
+// after it as there are, up to n, so that a file that asks
+// for the blocks after its last one gets them if they're
+// free. a goal of 0 means this hart's preferred group.
+// sets *got to the number allocated, and returns the first,
+// or 0 if out of disk space.
+static uint
+ballocn(uint dev, uint goal, uint n, uint *got)
+{
+  struct bgroup *g;
+  struct buf *bp;
+  uint bi, start, end, run, b;
+  int g0, gi, i, cpu;
+
+  push_off();
+  cpu = cpuid();
+  pop_off();
+  if(goal >= sb.size)
+    goal = 0;
+  g0 = goal ? goal / BPB : bgpref[cpu];
+
+  // the goal's group from the goal on, then every group,
+  // and last the part of the goal's group before the goal.
+  for(i = 0; i <= nbgroup; i++){
+    if(i == nbgroup && goal == 0)
+      break;
+    gi = (g0 + i) % nbgroup;
+    g = &bgroups[gi];
+    if(g->nfree == 0)
+      continue;
+    bp = bread(dev, sb.bmapstart + gi);
+    start = g->first;
+    if(i == 0 && goal && goal % BPB > start)
+      start = goal % BPB;
+    end = bgsize(gi);
+    for(bi = start; bi < end; bi++)
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        break;
+    if(bi == end){
+      if(start == g->first)
+        g->first = end;
+      brelse(bp);
+      continue;
+    }
+    for(run = 0; run < n && bi + run < end; run++){
+      if(bp->data[(bi+run)/8] & (1 << ((bi+run) % 8)))
+        break;
+      bp->data[(bi+run)/8] |= 1 << ((bi+run) % 8);  // Mark block in use.
+    }
+    g->nfree -= run;
+    if(start == g->first)
+      g->first = bi + run;
+    log_write(bp);
+    brelse(bp);
+    if(goal == 0)
+      bgpref[cpu] = gi;
+    b = gi * BPB + bi;
+    for(bi = 0; bi < run; bi++)
+      bzero(dev, b + bi);
+    *got = run;
+    return b;
+  }
+  printf("balloc: out of blocks\n");
+  return 0;
+}
+
+// Allocate a zeroed disk block, the first free one
+// from goal on. returns 0 if out of disk space.
+static uint
+balloc(uint dev, uint goal)
+{
+  uint got;
+
+  return ballocn(dev, goal, 1, &got);
+}
+
+// Free a disk block.
+static void
+bfree(int dev, uint b)
+{
+  struct bgroup *g;
+  struct buf *bp;
+  int bi, m;
+
+  bp = bread(dev, BBLOCK(b, sb));
+  bi = b % BPB;
+  m = 1 << (bi % 8);
+  if((bp->data[bi/8] & m) == 0)
+    panic("freeing free block");
+  bp->data[bi/8] &= ~m;
+  g = &bgroups[b / BPB];
+  g->nfree++;
+  if(bi < g->first)
+    g->first = bi;
+  log_write(bp);
+  brelse(bp);
+}
+
+// Inodes.
+//
+// An inode describes a single unnamed file. The inode
+// disk structure holds metadata: the file's type, its
+// size, the number of links referring to it, and the
+// list of blocks holding the file's content.
+//
+// The kernel keeps a table of in-use inodes in memory
+// to provide a place for synchronizing access to inodes
+// used by multiple processes. The in-memory inodes include
+// book-keeping information that is not stored on disk:
+// ip->ref and ip->valid.
+//
+// * Referencing in table: an entry in the inode table is free
+//   if ip->ref is zero. Otherwise ip->ref tracks the number of
+//   in-memory pointers to the entry (open files and current
+//   directories). iget() finds or creates a table entry and
+//   increments its ref; iput() decrements ref.
+//
+// * Valid: the information (type, size, &c) in an inode table
+//   entry is only correct when ip->valid is 1. ilock() reads
+//   the inode from the disk and sets ip->valid.
+//
+// * Locked: file system code may only examine and modify
+//   the information in an inode and its content if it
+//   has first locked the inode.
+//
+// Thus a typical sequence is:
+//   ip = iget(dev, inum)
+//   ilock(ip)
+//   ... examine ip->xxx ...
+//   iunlock(ip)
+//   iput(ip)
+//
+// ilock() is separate from iget() so that system calls can
+// get a long-term reference to an inode (as for an open file)
+// and only lock it for short periods (e.g., in read()).
+//
+// The itable.lock spin-lock protects the allocation of itable
+// entries. Since ip->ref indicates whether an entry is free,
+// and ip->dev and ip->inum indicate which i-node an entry
+// holds, one must hold itable.lock while using any of those fields.
+//
+// An ip->lock sleep-lock protects all ip-> fields other than ref,
+// dev, and inum.  One must hold ip->lock in order to
+// read or write that inode's ip->valid, ip->size, ip->type, &c.
+
+struct {
+  struct spinlock lock;
+  struct inode inode[NINODE];
+} itable;
+
+void
+iinit()
+{
+  int i = 0;
+  
+  initlock(&itable.lock, "itable");
+  for(i = 0; i < NINODE; i++) {
+    initsleeplock(&itable.inode[i].lock, "inode");
+  }
+}
+
+static struct inode* iget(uint dev, uint inum);
+
+// Allocate an inode on device dev.
+// Mark it as allocated by  giving it type type.
+// Returns an unlocked but allocated and referenced inode,
+// or NULL if there is no free inode.
+struct inode*
+ialloc(uint dev, short type)
+{
+  int inum;
+  struct buf *bp;
+  struct dinode *dip;
+
+  for(inum = 1; inum < sb.ninodes; inum++){
+    bp = bread(dev, IBLOCK(inum, sb));
+    dip = (struct dinode*)bp->data + inum%IPB;
+    if(dip->type == 0){  // a free inode
+      memset(dip, 0, sizeof(*dip));
+      dip->type = type;
+      log_write(bp);   // mark it allocated on the disk
+      brelse(bp);
+      return iget(dev, inum);
+    }
+    brelse(bp);
+  }
+  printf("ialloc: no inodes\n");
+  return 0;
+}
+
+// Copy a modified in-memory inode to disk.
+// Must be called after every change to an ip->xxx field
+// that lives on disk.
+// Caller must hold ip->lock.
+void
+iupdate(struct inode *ip)
+{
+  struct buf *bp;
+  struct dinode *dip;
+
+  bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+  dip = (struct dinode*)bp->data + ip->inum%IPB;
+  dip->type = ip->type;
+  dip->major = ip->major;
+  dip->minor = ip->minor;
+  dip->nlink = ip->nlink;
+  dip->size = ip->size;
+  memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
+  log_write(bp);
+  brelse(bp);
+}
+
+// Find the inode with number inum on device dev
+// and return the in-memory copy. Does not lock
+// the inode and does not read it from disk.
+static struct inode*
+iget(uint dev, uint inum)
+{
+  struct inode *ip, *empty;
+
+  acquire(&itable.lock);
+
+  // Is the inode already in the table?
+  empty = 0;
+  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
+    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+      ip->ref++;
+      release(&itable.lock);
+      return ip;
+    }
+    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
+      empty = ip;
+  }
+
+  // Recycle an inode entry.
+  if(empty == 0)
+    panic("iget: no inodes");
+
+  ip = empty;
+  ip->dev = dev;
+  ip->inum = inum;
+  ip->ref = 1;
+  ip->valid = 0;
+  release(&itable.lock);
+
+  return ip;
+}
+
+// Increment reference count for ip.
+// Returns ip to enable ip = idup(ip1) idiom.
+struct inode*
+idup(struct inode *ip)
+{
+  acquire(&itable.lock);
+  ip->ref++;
+  release(&itable.lock);
+  return ip;
+}
+
+// Lock the given inode.
+// Reads the inode from disk if necessary.
+void
+ilock(struct inode *ip)
+{
+  struct buf *bp;
+  struct dinode *dip;
+
+  if(ip == 0 || ip->ref < 1)
+    panic("ilock");
+
+  acquiresleep(&ip->lock);
+
+  if(ip->valid == 0){
+    bp = bread(ip->dev, IBLOCK(ip->inum, sb));
+    dip = (struct dinode*)bp->data + ip->inum%IPB;
+    ip->type = dip->type;
+    ip->major = dip->major;
+    ip->minor = dip->minor;
+    ip->nlink = dip->nlink;
+    ip->size = dip->size;
+    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    brelse(bp);
+    ip->valid = 1;
+    if(ip->type == 0)
+      panic("ilock: no type");
+  }
+}
+
+// Unlock the given inode.
+void
+iunlock(struct inode *ip)
+{
+  if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
+    panic("iunlock");
+
+  releasesleep(&ip->lock);
+}
+
+// Drop a reference to an in-memory inode.
+// If that was the last reference, the inode table entry can
+// be recycled.
+// If that was the last reference and the inode has no links
+// to it, free the inode (and its content) on disk.
+// All calls to iput() must be inside a transaction in
+// case it has to free the inode.
+void
+iput(struct inode *ip)
+{
+  acquire(&itable.lock);
+
+  if(ip->ref == 1 && ip->valid && ip->nlink == 0){
+    // inode has no links and no other references: truncate and free.
+
+    // ip->ref == 1 means no other process can have ip locked,
+    // so this acquiresleep() won't block (or deadlock).
+    acquiresleep(&ip->lock);
+
+    release(&itable.lock);
+
+    itrunc(ip);
+    ip->type = 0;
+    iupdate(ip);
+    ip->valid = 0;
+
+    releasesleep(&ip->lock);
+
+    acquire(&itable.lock);
+  }
+
+  ip->ref--;
+  release(&itable.lock);
+}
+
+// Common idiom: unlock, then put.
+void
+iunlockput(struct inode *ip)
+{
+  iunlock(ip);
+  iput(ip);
+}
+
+// Inode content
+//
+// The content (data) associated with each inode is stored
+// in blocks on the disk. In a classic file system, the first
+// NDIRECT block numbers are listed in ip->addrs[].  The next
+// NINDIRECT blocks are listed in block ip->addrs[NDIRECT].
+//
+// In an extent file system (sb.version FSV_EXTENT), the
+// blocks are in runs: ip->ext[] lists the first NEXTENT, in
+// order, and block ip->extblock up to NEXTENTBLK more. A
+// file grows by taking the block after its last one when
+// that's free, which just lengthens its last extent, so a
+// file written in one go is usually one extent, mapped
+// without reading anything but the inode.
+
+// the extent fs's bmap(). blocks can only be added at the
+// end: bn may be at most one past the last. alloc is the
+// number of blocks the caller is about to add from bn on,
+// which are allocated together where there's room, so a
+// write of several blocks takes a run of them at once.
+static uint
+emap(struct inode *ip, uint bn, int alloc)
+{
+  struct extent *e, *last;
+  struct buf *bp;
+  uint lbn, addr, goal, n;
+  int i;
+
+  bp = 0;
+  last = 0;
+  lbn = 0;   // the file block extent i starts at
+  for(i = 0; i < NEXTENT + NEXTENTBLK; i++){
+    if(i == NEXTENT){
+      if(ip->extblock == 0)
+        break;
+      bp = bread(ip->dev, ip->extblock);
+    }
+    e = i < NEXTENT ? &ip->ext[i] : (struct extent*)bp->data + (i - NEXTENT);
+    if(e->len == 0)
+      break;
+    if(bn < lbn + e->len){
+      addr = e->start + (bn - lbn);
+      if(bp)
+        brelse(bp);
+      return addr;
+    }
+    lbn += e->len;
+    last = e;
+  }
+  if(!alloc || bn != lbn)
+    goto fail;
+
+  // grow the last extent if the next blocks are free,
+  // or else start another.
+  goal = last ? last->start + last->len : 0;
+  if((addr = ballocn(ip->dev, goal, alloc, &n)) == 0)
+    goto fail;
+  if(last && addr == goal){
+    last->len += n;
+  } else if(i < NEXTENT + NEXTENTBLK){
+    if(i == NEXTENT){
+      // out of the way of the file's next blocks.
+      if((ip->extblock = balloc(ip->dev, 0)) == 0)
+        goto nospace;
+      bp = bread(ip->dev, ip->extblock);
+    }
+    e = i < NEXTENT ? &ip->ext[i] : (struct extent*)bp->data + (i - NEXTENT);
+    e->start = addr;
+    e->len = n;
+  } else {
+    // out of extents.
+    goto nospace;
+  }
+  // the caller writes the inode back, but not the extent block.
+  if(bp){
+    log_write(bp);
+    brelse(bp);
+  }
+  return addr;
+
+nospace:
+  while(n > 0)
+    bfree(ip->dev, addr + --n);
+fail:
+  if(bp)
+    brelse(bp);
+  return 0;
+}
+
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block and alloc is set, bmap allocates one;
+// an extent file's may allocate alloc blocks at once (emap()).
+// returns 0 if there is no such block, or if out of disk space.
+static uint
+bmap(struct inode *ip, uint bn, int alloc)
+{
+  uint addr, *a;
+  struct buf *bp;
+
+  if(sb.version == FSV_EXTENT)
+    return emap(ip, bn, alloc);
+
+  if(bn < NDIRECT){
+    if((addr = ip->addrs[bn]) == 0 && alloc){
+      addr = balloc(ip->dev, 0);
+      ip->addrs[bn] = addr;
+    }
+    return addr;
+  }
+  bn -= NDIRECT;
+
+  if(bn < NINDIRECT){
+    // Load indirect block, allocating if necessary.
+    if((addr = ip->addrs[NDIRECT]) == 0){
+      if(!alloc)
+        return 0;
+      addr = balloc(ip->dev, 0);
+      if(addr == 0)
+        return 0;
+      ip->addrs[NDIRECT] = addr;
+    }
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    if((addr = a[bn]) == 0 && alloc){
+      addr = balloc(ip->dev, 0);
+      if(addr){
+        a[bn] = addr;
+        log_write(bp);
+      }
+    }
+    brelse(bp);
+    return addr;
+  }
+
+  panic("bmap: out of range");
+}
+
+// Truncate inode (discard contents).
+// Caller must hold ip->lock.
+void
+itrunc(struct inode *ip)
+{
+  int i, j;
+  struct buf *bp;
+  struct extent *e;
+  uint *a;
+
+  if(sb.version == FSV_EXTENT){
+    for(i = 0; i < NEXTENT; i++)
+      for(j = 0; j < ip->ext[i].len; j++)
+        bfree(ip->dev, ip->ext[i].start + j);
+    if(ip->extblock){
+      bp = bread(ip->dev, ip->extblock);
+      e = (struct extent*)bp->data;
+      for(i = 0; i < NEXTENTBLK; i++)
+        for(j = 0; j < e[i].len; j++)
+          bfree(ip->dev, e[i].start + j);
+      brelse(bp);
+      bfree(ip->dev, ip->extblock);
+    }
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
+
+  for(i = 0; i < NDIRECT; i++){
+    if(ip->addrs[i]){
+      bfree(ip->dev, ip->addrs[i]);
+      ip->addrs[i] = 0;
+    }
+  }
+
+  if(ip->addrs[NDIRECT]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT]);
+    a = (uint*)bp->data;
+    for(j = 0; j < NINDIRECT; j++){
+      if(a[j])
+        bfree(ip->dev, a[j]);
+    }
+    brelse(bp);
+    bfree(ip->dev, ip->addrs[NDIRECT]);
+    ip->addrs[NDIRECT] = 0;
+  }
+
+  ip->size = 0;
+  iupdate(ip);
+}
+
+// Copy stat information from inode.
+// Caller must hold ip->lock.
+void
+stati(struct inode *ip, struct stat *st)
+{
+  st->dev = ip->dev;
+  st->ino = ip->inum;
+  st->type = ip->type;
+  st->nlink = ip->nlink;
+  st->size = ip->size;
+}
+
+// Read data from inode.
+// Caller must hold ip->lock.
+// If user_dst==1, then dst is a user virtual address;
+// otherwise, dst is a kernel address.
+int
+readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  uint tot, m;
+  struct buf *bp;
+
+  if(off > ip->size || off + n < off)
+    return 0;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    uint addr = bmap(ip, off/BSIZE, 0);
+    if(addr == 0)
+      break;
+    bp = bread(ip->dev, addr);
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(user_dst){
+      if(copy_to_user(dst, bp->data + (off % BSIZE), m) < 0){
+        brelse(bp);
+        tot = -1;
+        break;
+      }
+    } else
+      memmove((char*)dst, bp->data + (off % BSIZE), m);
+    brelse(bp);
+  }
+  return tot;
+}
+
+// Write data to inode.
+// Caller must hold ip->lock.
+// If user_src==1, then src is a user virtual address;
+// otherwise, src is a kernel address.
+// Returns the number of bytes successfully written.
+// If the return value is less than the requested n,
+// there was an error of some kind.
+int
+writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+{
+  uint tot, m;
+  struct buf *bp;
+
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(sb.version == FSV_CLASSIC && off + n > MAXFILE*BSIZE)
+    return -1;
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    // the blocks left to write, so that new ones
+    // can be allocated together.
+    uint nb = (off + (n - tot) - 1) / BSIZE - off / BSIZE + 1;
+    uint addr = bmap(ip, off/BSIZE, nb);
+    if(addr == 0)
+      break;
+    bp = bread(ip->dev, addr);
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(user_src){
+      if(copy_from_user(bp->data + (off % BSIZE), src, m) < 0){
+        brelse(bp);
+        break;
+      }
+    } else
+      memmove(bp->data + (off % BSIZE), (char*)src, m);
+    log_write(bp);
+    brelse(bp);
+  }
+
+  if(off > ip->size)
+    ip->size = off;
+
+  // write the i-node back to disk even if the size didn't change
+  // because the loop above might have called bmap() and added a new
+  // block to ip->addrs[] or ip->ext[].
+  iupdate(ip);
+
+  return tot;
+}
+
+// Readahead.
+//
+// A reader that starts at the beginning of a file, or picks
+// up where its last read stopped, is reading sequentially.
+// Its first read starts a window of RA_INIT blocks, from the
+// block it asked for. Once it gets halfway through a window,
+// the next one starts, twice the size, up to RA_MAX blocks,
+// so the disk stays ahead of a reader that keeps up. Each
+// window is read asynchronously as a batch of requests,
+// merged where the blocks are next to each other on disk
+// (bprefetch() in bio.c), and the reader waits only when it
+// reaches a block that hasn't arrived yet. A read anywhere
+// else ends the window.
+
+#define RA_INIT 4
+#define RA_MAX  min(64, NBUF/4)  // leave the cache to others
+
+// the block that maps ip's blocks from *first on, if there
+// is one: the indirect block, or the extent block.
+static uint
+imapblock(struct inode *ip, uint *first)
+{
+  int i;
+
+  if(sb.version == FSV_CLASSIC){
+    *first = NDIRECT;
+    return ip->addrs[NDIRECT];
+  }
+  *first = 0;
+  for(i = 0; i < NEXTENT; i++)
+    *first += ip->ext[i].len;
+  return ip->extblock;
+}
+
+// read blocks [start, end) of ip ahead. the blocks past the
+// ones the inode maps itself are mapped through another
+// block; it goes in file order, which is usually where it
+// is on disk, and bmap() waits for just it before mapping
+// them.
+static void
+ireadwindow(struct inode *ip, uint start, uint end)
+{
+  uint blocks[RA_MAX + 1];
+  uint bn, first, mapblock;
+  int n;
+
+  mapblock = imapblock(ip, &first);
+  n = 0;
+  for(bn = start; bn < end; bn++){
+    if(bn == first && mapblock){
+      blocks[n++] = mapblock;
+      bprefetch(ip->dev, blocks, n);
+      n = 0;
+    }
+    if((blocks[n] = bmap(ip, bn, 0)) != 0)
+      n++;
+  }
+  // a window that stops where the inode's own mapping
+  // does reads the block that maps the next.
+  if(end == first && mapblock)
+    blocks[n++] = mapblock;
+  bprefetch(ip->dev, blocks, n);
+}
+
+// a read of n bytes at off in ip, through ra, is about to
+// happen: start reading ahead of it if it's sequential.
+// caller must hold ip->lock.
+void
+ireadahead(struct inode *ip, struct readahead *ra, uint off, uint n)
+{
+  uint first, last, nblocks;
+
+  if(!fs_readahead || n == 0 || off >= ip->size)
+    return;
+  if(off + n > ip->size)
+    n = ip->size - off;
+  first = off / BSIZE;
+  last = (off + n - 1) / BSIZE;
+  nblocks = (ip->size + BSIZE - 1) / BSIZE;
+
+  if(first != 0 && first != ra->next){
+    ra->size = 0;
+  } else {
+    if(ra->size == 0){
+      ra->start = first;
+      ra->size = RA_INIT;
+      while(ra->size < last - first + 1 && ra->size < RA_MAX)
+        ra->size *= 2;
+      ireadwindow(ip, ra->start, min(ra->start + ra->size, nblocks));
+    }
+    while(last >= ra->start + ra->size / 2 &&
+          ra->start + ra->size < nblocks){
+      ra->start += ra->size;
+      if(ra->size < RA_MAX)
+        ra->size *= 2;
+      ireadwindow(ip, ra->start, min(ra->start + ra->size, nblocks));
+    }
+  }
+  ra->next = last + 1;
+}
+
+// Directories
+//
+// A directory that mkfs made with an index (see fs.h) is
+// searched and added to through it: a name is only ever in
+// the chain of blocks of the bucket it hashes to, except "."
+// and "..", which are in the root block's first slots. Other
+// directories are searched from start to end. Removing an
+// entry just clears it, wherever it is.
+
+int
+namecmp(const char *s, const char *t)
+{
+  return strncmp(s, t, DIRSIZ);
+}
+
+// the hash of a name, for the directory index. FNV-1a;
+// mkfs/mkfs.c has a copy.
+static uint
+dxhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// if dp is indexed, return the bucket name is in, and set
+// *head to the first block of its chain (0 if it has none).
+// otherwise return -1.
+static int
+dxbucket(struct inode *dp, char *name, uint *head)
+{
+  struct dxslot *x;
+  struct buf *bp;
+  uint addr, nb;
+  int b;
+
+  if(dp->size < BSIZE || (addr = bmap(dp, 0, 0)) == 0)
+    return -1;
+  bp = bread(dp->dev, addr);
+  x = (struct dxslot*)bp->data;
+  nb = x[2].w[1];
+  if(x[2].inum != 0 || x[2].w[0] != DXMAGIC || nb == 0 || nb > DXMAXBUCKET){
+    brelse(bp);
+    return -1;
+  }
+  b = dxhash(name) % nb;
+  *head = x[3 + b/3].w[b%3];
+  brelse(bp);
+  return b;
+}
+
+// look for name in the chain of blocks of dp from lbn on.
+static struct inode*
+dxlookup(struct inode *dp, char *name, uint lbn, uint *poff)
+{
+  struct dirent *de;
+  struct buf *bp;
+  uint addr, inum;
+  int i;
+
+  while(lbn != 0){
+    if((addr = bmap(dp, lbn, 0)) == 0)
+      panic("dxlookup");
+    bp = bread(dp->dev, addr);
+    de = (struct dirent*)bp->data;
+    for(i = 0; i < DXPERBLOCK; i++){
+      if(de[i].inum != 0 && namecmp(name, de[i].name) == 0){
+        if(poff)
+          *poff = lbn * BSIZE + i * sizeof(*de);
+        inum = de[i].inum;
+        brelse(bp);
+        return iget(dp->dev, inum);
+      }
+    }
+    lbn = ((struct dxslot*)bp->data)[DXPERBLOCK].w[0];
+    brelse(bp);
+  }
+  return 0;
+}
+
+// add (name, inum) to bucket b of dp, whose chain starts at
+// block lbn: in a free entry, or if there are none, in a new
+// block on the end of the directory and the chain.
+static int
+dxadd(struct inode *dp, char *name, uint inum, int b, uint lbn)
+{
+  struct dirent *de;
+  struct dxslot *x;
+  struct buf *bp;
+  uint addr, prev;
+  int i;
+
+  prev = 0;   // the block that links to lbn; 0 for the root
+  while(lbn != 0){
+    if((addr = bmap(dp, lbn, 0)) == 0)
+      panic("dxadd");
+    bp = bread(dp->dev, addr);
+    de = (struct dirent*)bp->data;
+    for(i = 0; i < DXPERBLOCK; i++){
+      if(de[i].inum == 0){
+        strncpy(de[i].name, name, DIRSIZ);
+        de[i].inum = inum;
+        log_write(bp);
+        brelse(bp);
+        return 0;
+      }
+    }
+    prev = lbn;
+    lbn = ((struct dxslot*)bp->data)[DXPERBLOCK].w[0];
+    brelse(bp);
+  }
+
+  lbn = dp->size / BSIZE;
+  if((addr = bmap(dp, lbn, 1)) == 0)
+    return -1;
+  bp = bread(dp->dev, addr);
+  de = (struct dirent*)bp->data;
+  strncpy(de[0].name, name, DIRSIZ);
+  de[0].inum = inum;
+  log_write(bp);
+  brelse(bp);
+  dp->size += BSIZE;
+  iupdate(dp);
+
+  bp = bread(dp->dev, bmap(dp, prev, 0));
+  x = (struct dxslot*)bp->data;
+  if(prev == 0)
+    x[3 + b/3].w[b%3] = lbn;
+  else
+    x[DXPERBLOCK].w[0] = lbn;
+  log_write(bp);
+  brelse(bp);
+  return 0;
+}
+
+// Look for a directory entry in a directory.
+// If found, set *poff to byte offset of entry.
+struct inode*
+dirlookup(struct inode *dp, char *name, uint *poff)
+{
+  uint off, inum;
+  struct dirent de;
+
+  if(dp->type != T_DIR)
+    panic("dirlookup not DIR");
+
+  // "." and ".." are in the first two slots of an indexed
+  // directory's root, not in a bucket; the scan below finds
+  // them there at once.
+  if(namecmp(name, ".") != 0 && namecmp(name, "..") != 0 &&
+     dxbucket(dp, name, &off) >= 0)
+    return dxlookup(dp, name, off, poff);
+
+  for(off = 0; off < dp->size; off += sizeof(de)){
+    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("dirlookup read");
+    if(de.inum == 0)
+      continue;
+    if(namecmp(name, de.name) == 0){
+      // entry matches path element
+      if(poff)
+        *poff = off;
+      inum = de.inum;
+      return iget(dp->dev, inum);
+    }
+  }
+
+  return 0;
+}
+
+// Write a new directory entry (name, inum) into the directory dp.
+// Returns 0 on success, -1 on failure (e.g. out of disk blocks).
+int
+dirlink(struct inode *dp, char *name, uint inum)
+{
+  int off, b;
+  struct dirent de;
+  struct inode *ip;
+  uint head;
+
+  // Check that name is not present.
+  if((ip = dirlookup(dp, name, 0)) != 0){
+    iput(ip);
+    return -1;
+  }
+
+  if((b = dxbucket(dp, name, &head)) >= 0)
+    return dxadd(dp, name, inum, b, head);
+
+  // Look for an empty dirent.
+  for(off = 0; off < dp->size; off += sizeof(de)){
+    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("dirlink read");
+    if(de.inum == 0)
+      break;
+  }
+
+  strncpy(de.name, name, DIRSIZ);
+  de.inum = inum;
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    return -1;
+
+  return 0;
+}
+
+// Paths
+
+// Copy the next path element from path into name.
+// Return a pointer to the element following the copied one.
+// The returned path has no leading slashes,
+// so the caller can check *path=='\0' to see if the name is the last one.
+// If no name to remove, return 0.
+//
+// Examples:
+//   skipelem("a/bb/c", name) = "bb/c", setting name = "a"
+//   skipelem("///a//bb", name) = "bb", setting name = "a"
+//   skipelem("a", name) = "", setting name = "a"
+//   skipelem("", name) = skipelem("////", name) = 0
+//
+static char*
+skipelem(char *path, char *name)
+{
+  char *s;
+  int len;
+
+  while(*path == '/')
+    path++;
+  if(*path == 0)
+    return 0;
+  s = path;
+  while(*path != '/' && *path != 0)
+    path++;
+  len = path - s;
+  if(len >= DIRSIZ)
+    memmove(name, s, DIRSIZ);
+  else {
+    memmove(name, s, len);
+    name[len] = 0;
+  }
+  while(*path == '/')
+    path++;
+  return path;
+}
+
+// Look up and return the inode for a path name.
+// If parent != 0, return the inode for the parent and copy the final
+// path element into name, which must have room for DIRSIZ bytes.
+// Processes have no current directory, so every path is
+// looked up from the root.
+static struct inode*
+namex(char *path, int nameiparent, char *name)
+{
+  struct inode *ip, *next;
+
+  ip = iget(ROOTDEV, ROOTINO);
+
+  while((path = skipelem(path, name)) != 0){
+    ilock(ip);
+    if(ip->type != T_DIR){
+      iunlockput(ip);
+      return 0;
+    }
+    if(nameiparent && *path == '\0'){
+      // Stop one level early.
+      iunlock(ip);
+      return ip;
+    }
+    if((next = dirlookup(ip, name, 0)) == 0){
+      iunlockput(ip);
+      return 0;
+    }
+    iunlockput(ip);
+    ip = next;
+  }
+  if(nameiparent){
+    iput(ip);
+    return 0;
+  }
+  return ip;
+}
+
+struct inode*
+namei(char *path)
+{
+  char name[DIRSIZ];
+  return namex(path, 0, name);
+}
+
+struct inode*
+nameiparent(char *path, char *name)
+{
+  return namex(path, 1, name);
+}
@@ -0,0 +1,102 @@
+// On-disk file system format.
+// Both the kernel and user programs use this header file.
+
+
+#define ROOTINO  1   // root i-number
+#define BSIZE 1024  // block size
+
+// Disk layout:
+// [ boot block | super block | log | inode blocks |
+//                                          free bit map | data blocks]
+//
+// mkfs computes the super block and builds an initial file system. The
+// super block describes the disk layout:
+struct superblock {
+  uint magic;        // Must be FSMAGIC
+  uint size;         // Size of file system image (blocks)
+  uint nblocks;      // Number of data blocks
+  uint ninodes;      // Number of inodes.
+  uint nlog;         // Number of log blocks
+  uint logstart;     // Block number of first log block
+  uint inodestart;   // Block number of first inode block
+  uint bmapstart;    // Block number of first free map block
+  uint version;      // How inodes map their blocks: FSV_*
+};
+
+#define FSMAGIC 0x10203040
+
+#define FSV_CLASSIC 0  // addrs[]: direct blocks and an indirect block
+#define FSV_EXTENT  1  // ext[]: extents, and a block of more
+
+#define NDIRECT 12
+#define NINDIRECT (BSIZE / sizeof(uint))
+#define MAXFILE (NDIRECT + NINDIRECT)
+
+// A run of len blocks on disk, starting at start. A file's
+// extents map its blocks in order: the first len blocks of
+// the file are in the first extent, and so on.
+struct extent {
+  uint start;
+  uint len;             // 0 if unused
+};
+
+#define NEXTENT 6       // extents in the inode
+#define NEXTENTBLK (BSIZE / sizeof(struct extent)) // in an overflow block
+
+// On-disk inode structure
+struct dinode {
+  short type;           // File type
+  short major;          // Major device number (T_DEVICE only)
+  short minor;          // Minor device number (T_DEVICE only)
+  short nlink;          // Number of links to inode in file system
+  uint size;            // Size of file (bytes)
+  union {
+    uint addrs[NDIRECT+1];   // FSV_CLASSIC: Data block addresses
+    struct {                 // FSV_EXTENT:
+      struct extent ext[NEXTENT];
+      uint extblock;         // block of NEXTENTBLK more, or 0
+    };
+  };
+};
+
+// Inodes per block.
+#define IPB           (BSIZE / sizeof(struct dinode))
+
+// Block containing inode i
+#define IBLOCK(i, sb)     ((i) / IPB + sb.inodestart)
+
+// Bitmap bits per block
+#define BPB           (BSIZE*8)
+
+// Block of free map containing bit for block b
+#define BBLOCK(b, sb) ((b)/BPB + sb.bmapstart)
+
+// Directory is a file containing a sequence of dirent structures.
+#define DIRSIZ 14
+
+struct dirent {
+  ushort inum;
+  char name[DIRSIZ];
+};
+
+// A directory may be indexed by a hash of the names in it.
+// Its first block is then the root of the index: ".", "..",
+// a header, and the first block of each hash bucket. A bucket
+// is a chain of directory blocks, each holding DXPERBLOCK
+// dirents and the block after it in the chain. All of these
+// are directory blocks (block numbers within the directory),
+// and every word of the index is in a dxslot, shaped like a
+// free dirent, so that reading an indexed directory as a list
+// of dirents still works.
+struct dxslot {
+  ushort inum;     // 0: a free dirent
+  ushort pad;
+  uint w[3];
+};
+
+#define DXMAGIC     0x78646968  // in w[0] of the root's third slot,
+                                // with the number of buckets in w[1]
+#define DXSLOTS     (BSIZE / sizeof(struct dirent))
+#define DXMAXBUCKET ((DXSLOTS - 3) * 3) // heads, 3 a slot, after the header
+#define DXPERBLOCK  (DXSLOTS - 1)       // the last slot has the next block in w[0]
+#define DXBUCKETS   64                  // buckets mkfs gives the root
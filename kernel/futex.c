@@ -0,0 +1,249 @@
+//
+// futexes: blocking for user-space locks.
+//
+// a futex is an aligned 32-bit word in user memory. user code
+// takes and releases its locks with atomic instructions on that
+// word and only enters the kernel when it must wait (futex_wait)
+// or when it knows there may be waiters to wake (futex_wake),
+// so an uncontended lock never traps.
+//
+// waiters are queued in a hash table keyed by the physical
+// address of the futex word, so that every mapping of the same
+// page finds the same queue.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "errno.h"
+#include "defs.h"
+
+#define NFUTEXHASH 64
+
+// a waiter lives on the kernel stack of the sleeping
+// process, linked into its bucket while it waits.
+struct futex_waiter {
+  struct futex_waiter *next;
+  uint64 pa;          // physical address of the futex word
+  int woken;          // set by futex_wake()
+  uint deadline;      // give up when ticks reaches this; 0 means never
+};
+
+struct futex_bucket {
+  struct spinlock lock;
+  struct futex_waiter *head;
+  int ntimed;         // waiters in this bucket with a deadline
+};
+
+static struct futex_bucket futex_table[NFUTEXHASH];
+
+// number of timed waiters in all buckets, so that
+// futex_tick() costs nothing when nobody has a timeout.
+static int futex_ntimed;
+
+void
+futexinit(void)
+{
+  struct futex_bucket *b;
+
+  for(b = futex_table; b < &futex_table[NFUTEXHASH]; b++){
+    initlock(&b->lock, "futex");
+    b->head = 0;
+    b->ntimed = 0;
+  }
+}
+
+static struct futex_bucket*
+futex_bucket(uint64 pa)
+{
+  // futex words are 4-byte aligned; mix in the page
+  // number so neighbouring pages spread out too.
+  return &futex_table[((pa >> 2) ^ (pa >> PGSHIFT)) % NFUTEXHASH];
+}
+
+// translate the user address of a futex word to the
+// physical address that keys its wait queue.
+// returns 0 if uaddr is misaligned or not mapped.
+static uint64
+futex_pa(uint64 uaddr)
+{
+  uint64 pa;
+
+  if(uaddr % sizeof(uint32))
+    return 0;
+  pa = walkaddr(myproc()->pagetable, PGROUNDDOWN(uaddr));
+  if(pa == 0)
+    return 0;
+  return pa + (uaddr - PGROUNDDOWN(uaddr));
+}
+
+// unlink w from b. caller must hold b->lock.
+static void
+futex_unlink(struct futex_bucket *b, struct futex_waiter *w)
+{
+  struct futex_waiter **pp;
+
+  for(pp = &b->head; *pp; pp = &(*pp)->next){
+    if(*pp == w){
+      *pp = w->next;
+      break;
+    }
+  }
+  if(w->deadline){
+    b->ntimed--;
+    __sync_fetch_and_sub(&futex_ntimed, 1);
+  }
+}
+
+// sleep until futex_wake() on uaddr, provided the futex word
+// still holds val. timeout is in ticks; 0 waits forever.
+// returns 0 if woken, -EAGAIN if the word had changed,
+// -ETIMEDOUT, -EINTR if killed, or -EFAULT.
+int
+futex_wait(uint64 uaddr, uint32 val, uint timeout)
+{
+  struct proc *p = myproc();
+  struct futex_bucket *b;
+  struct futex_waiter w;
+  uint64 pa;
+  int r;
+
+  if((pa = futex_pa(uaddr)) == 0)
+    return -EFAULT;
+  b = futex_bucket(pa);
+
+  w.pa = pa;
+  w.woken = 0;
+  w.deadline = 0;
+  if(timeout){
+    w.deadline = ticks + timeout;
+    if(w.deadline == 0)
+      w.deadline = 1;
+  }
+
+  acquire(&b->lock);
+
+  // the check and the enqueue are atomic with respect to
+  // futex_wake(), which takes the same bucket lock, so a
+  // waker that changes the word after this load cannot
+  // miss us.
+  if(*(volatile uint32*)pa != val){
+    release(&b->lock);
+    return -EAGAIN;
+  }
+
+  w.next = b->head;
+  b->head = &w;
+  if(w.deadline){
+    b->ntimed++;
+    __sync_fetch_and_add(&futex_ntimed, 1);
+  }
+
+  r = 0;
+  while(!w.woken){
+    if(p->killed){
+      r = -EINTR;
+      break;
+    }
+    if(w.deadline && (int)(ticks - w.deadline) >= 0){
+      r = -ETIMEDOUT;
+      break;
+    }
+    sleep(&w, &b->lock);
+  }
+  if(!w.woken)
+    futex_unlink(b, &w);
+
+  release(&b->lock);
+  return r;
+}
+
+// wake up to n processes waiting on uaddr.
+// returns the number woken, or -EFAULT.
+int
+futex_wake(uint64 uaddr, int n)
+{
+  struct futex_bucket *b;
+  struct futex_waiter **pp, *w;
+  uint64 pa;
+  int woken;
+
+  if((pa = futex_pa(uaddr)) == 0)
+    return -EFAULT;
+  b = futex_bucket(pa);
+
+  woken = 0;
+  acquire(&b->lock);
+  pp = &b->head;
+  while((w = *pp) != 0 && woken < n){
+    if(w->pa != pa){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    if(w->deadline){
+      b->ntimed--;
+      __sync_fetch_and_sub(&futex_ntimed, 1);
+    }
+    w->woken = 1;
+    wakeup(w);
+    woken++;
+  }
+  release(&b->lock);
+
+  return woken;
+}
+
+// called from clockintr() without tickslock held:
+// wake timed waiters whose deadline has passed.
+// they dequeue themselves.
+void
+futex_tick(void)
+{
+  struct futex_bucket *b;
+  struct futex_waiter *w;
+
+  if(futex_ntimed == 0)
+    return;
+
+  for(b = futex_table; b < &futex_table[NFUTEXHASH]; b++){
+    if(b->ntimed == 0)
+      continue;
+    acquire(&b->lock);
+    for(w = b->head; w; w = w->next){
+      if(w->deadline && (int)(ticks - w->deadline) >= 0)
+        wakeup(w);
+    }
+    release(&b->lock);
+  }
+}
+
+uint64
+sys_futex_wait(void)
+{
+  uint64 uaddr;
+  int val, timeout;
+
+  argaddr(0, &uaddr);
+  argint(1, &val);
+  argint(2, &timeout);
+  if(timeout < 0)
+    return -EINVAL;
+  return futex_wait(uaddr, val, timeout);
+}
+
+uint64
+sys_futex_wake(void)
+{
+  uint64 uaddr;
+  int n;
+
+  argaddr(0, &uaddr);
+  argint(1, &n);
+  if(n <= 0)
+    return -EINVAL;
+  return futex_wake(uaddr, n);
+}
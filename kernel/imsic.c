@@ -0,0 +1,189 @@
+//
+// AIA interrupt controller back end: an APLIC that turns wired
+// device interrupts into MSIs, and the per-hart IMSIC interrupt
+// files that receive them. used instead of the PLIC when the
+// kernel is built with AIA=1 (qemu -machine virt,aia=aplic-imsic).
+//
+// an interrupt arrives as an identity in the target hart's own
+// IMSIC file, and the hart claims it with one CSR access to
+// stopei instead of an MMIO round trip to the PLIC.
+//
+// identities are per hart. 1..NIRQ-1 stand for the APLIC's
+// wired sources, so devintr() sees the same numbers as with the
+// PLIC; the rest are handed out by msi_alloc() to devices that
+// can write an MSI themselves, so each such device can interrupt
+// exactly the hart that owns the queue it completed.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "intc.h"
+#include "defs.h"
+
+// APLIC registers, as offsets from a domain's base.
+#define APLIC_DOMAINCFG      0x0000
+#define APLIC_DOMAINCFG_IE   (1 << 8)  // interrupts enabled
+#define APLIC_DOMAINCFG_DM   (1 << 2)  // deliver by MSI
+#define APLIC_SOURCECFG(irq) (0x0004 + ((irq)-1)*4)
+#define APLIC_SOURCECFG_D    (1 << 10) // delegate to child domain 0
+#define APLIC_SM_LEVEL_HIGH  6
+#define APLIC_MMSIADDRCFG    0x1bc0    // machine domain only
+#define APLIC_MMSIADDRCFGH   0x1bc4
+#define APLIC_SMSIADDRCFG    0x1bc8
+#define APLIC_SMSIADDRCFGH   0x1bcc
+#define APLIC_LHXW(w)        ((w) << 12) // bits of hart index in MSI address
+#define APLIC_SETIPNUM       0x1cdc
+#define APLIC_IN_CLRIP(irq)  (0x1d00 + ((irq)/32)*4)
+#define APLIC_SETIENUM       0x1edc
+#define APLIC_TARGET(irq)    (0x3004 + ((irq)-1)*4)
+#define APLIC_TARGET_HART(h) ((h) << 18)
+
+#define AplicReg(base, reg) ((volatile uint32 *)((base) + (reg)))
+
+// identities in each hart's interrupt file. SISELECT_EIE0
+// covers 0..63; identity 0 means none.
+#define NIMSICID 64
+
+// the wired sources the kernel uses.
+static int aplic_irqs[] = { UART0_IRQ, VIRTIO0_IRQ };
+
+// per-hart handlers for identities NIRQ..NIMSICID-1.
+static struct {
+  struct spinlock lock;
+  struct {
+    void (*fn)(void*);
+    void *arg;
+  } vec[NCPU][NIMSICID];
+} msi;
+
+void
+imsicinit(void)
+{
+  int i, irq;
+
+  initlock(&msi.lock, "msi");
+
+  // there's no firmware, so the machine-level domain is
+  // ours to set up: tell it where each hart's IMSIC files
+  // are, 4096 bytes apart, and hand our sources down to
+  // the supervisor-level domain.
+  *AplicReg(APLIC_M, APLIC_MMSIADDRCFG) = IMSIC_M >> 12;
+  *AplicReg(APLIC_M, APLIC_MMSIADDRCFGH) = APLIC_LHXW(3); // up to NCPU harts
+  *AplicReg(APLIC_M, APLIC_SMSIADDRCFG) = IMSIC_S >> 12;
+  *AplicReg(APLIC_M, APLIC_SMSIADDRCFGH) = 0;
+  for(i = 0; i < NELEM(aplic_irqs); i++)
+    *AplicReg(APLIC_M, APLIC_SOURCECFG(aplic_irqs[i])) = APLIC_SOURCECFG_D;
+
+  // in the supervisor domain, each source is a level-high
+  // wire whose MSI carries its own number as the identity.
+  // irq.c picks the target hart through imsic_route().
+  for(i = 0; i < NELEM(aplic_irqs); i++){
+    irq = aplic_irqs[i];
+    *AplicReg(APLIC_S, APLIC_SOURCECFG(irq)) = APLIC_SM_LEVEL_HIGH;
+    *AplicReg(APLIC_S, APLIC_TARGET(irq)) = APLIC_TARGET_HART(0) | irq;
+    *AplicReg(APLIC_S, APLIC_SETIENUM) = irq;
+  }
+  *AplicReg(APLIC_S, APLIC_DOMAINCFG) = APLIC_DOMAINCFG_IE | APLIC_DOMAINCFG_DM;
+}
+
+void
+imsicinithart(void)
+{
+  // accept every identity; which hart sees a wired
+  // source is decided in the APLIC, not here.
+  w_siselect(SISELECT_EIE0);
+  w_sireg(~1UL);
+  w_siselect(SISELECT_EITHRESHOLD);
+  w_sireg(0);
+  w_siselect(SISELECT_EIDELIVERY);
+  w_sireg(1);
+}
+
+// claim this hart's highest-priority pending identity.
+int
+imsic_claim(void)
+{
+  return (stopei_claim() >> 16) & 0x7ff;
+}
+
+// an MSI is gone once claimed, but a level-triggered wire
+// that is still asserted must be sent again by hand.
+void
+imsic_complete(int irq)
+{
+  if(irq >= NIRQ)
+    return;
+  if(*AplicReg(APLIC_S, APLIC_IN_CLRIP(irq)) & (1 << (irq % 32)))
+    *AplicReg(APLIC_S, APLIC_SETIPNUM) = irq;
+}
+
+// an MSI goes to exactly one hart: the lowest in harts.
+void
+imsic_route(int irq, uint harts)
+{
+  int hart;
+
+  for(hart = 0; hart < NCPU; hart++)
+    if(harts & (1 << hart))
+      break;
+  if(hart == NCPU)
+    return;
+  *AplicReg(APLIC_S, APLIC_TARGET(irq)) = APLIC_TARGET_HART(hart) | irq;
+}
+
+// allocate an identity on hart for a device that writes its
+// own MSIs, and arrange for fn(arg) to run on that hart when
+// it fires. the device should write *data to *addr.
+// returns the identity, or -1 if hart has none left.
+int
+msi_alloc(int hart, void (*fn)(void*), void *arg, uint64 *addr, uint32 *data)
+{
+  int id;
+
+  acquire(&msi.lock);
+  for(id = NIRQ; id < NIMSICID; id++){
+    if(msi.vec[hart][id].fn == 0){
+      msi.vec[hart][id].fn = fn;
+      msi.vec[hart][id].arg = arg;
+      release(&msi.lock);
+      *addr = IMSIC_S_HART(hart); // seteipnum_le
+      *data = id;
+      return id;
+    }
+  }
+  release(&msi.lock);
+  return -1;
+}
+
+void
+msi_free(int hart, int id)
+{
+  acquire(&msi.lock);
+  msi.vec[hart][id].fn = 0;
+  msi.vec[hart][id].arg = 0;
+  release(&msi.lock);
+}
+
+// called by devintr() for an identity above the wired range.
+void
+msiintr(int id)
+{
+  int hart = cpuid();
+
+  if(id < NIMSICID && msi.vec[hart][id].fn)
+    msi.vec[hart][id].fn(msi.vec[hart][id].arg);
+  else
+    printf("unexpected msi %d on hart %d\n", id, hart);
+}
+
+struct intc imsic_intc = {
+  .name = "imsic",
+  .init = imsicinit,
+  .inithart = imsicinithart,
+  .claim = imsic_claim,
+  .complete = imsic_complete,
+  .route = imsic_route,
+};
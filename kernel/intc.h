@@ -0,0 +1,15 @@
+// An interrupt controller back end. irqinit() picks one;
+// devintr() and irq.c go through it.
+struct intc {
+  char *name;
+  void (*init)(void);          // once, on hart 0
+  void (*inithart)(void);      // on each hart
+  int (*claim)(void);          // this hart's next pending IRQ, or 0
+  void (*complete)(int);       // done handling a claimed IRQ
+  void (*route)(int, uint);    // deliver an IRQ to a bitmap of harts
+};
+
+extern struct intc *intc;
+
+extern struct intc plic_intc;   // plic.c
+extern struct intc imsic_intc;  // imsic.c
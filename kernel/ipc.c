@@ -0,0 +1,316 @@
+//
+// synchronous IPC through endpoints, in the style of L4.
+//
+// a client sends a message with ipc_call() and blocks until
+// the server replies; a server answers its current client and
+// waits for the next message with ipc_reply_wait(), or just
+// answers with ipc_reply(). messages are NIPCMSG words that
+// travel in a1.. of the trapframes, so nothing is copied
+// through user memory.
+//
+// when the other side is already waiting, the sender gives
+// its CPU straight to it with sleep_handoff(), so a call and
+// its reply each cost one context switch and no trip through
+// scheduler() or the run queue.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
+#include "errno.h"
+#include "defs.h"
+
+#define NENDPOINT 16   // endpoints, numbered from 0
+#define NIPCMSG    4   // message words, in a1..a4
+
+// p->ipc_state.
+#define IPC_NONE   0
+#define IPC_SEND   1   // caller, queued for a receiver
+#define IPC_REPLY  2   // caller, message taken, awaiting reply
+#define IPC_RECV   3   // receiver, awaiting a message
+#define IPC_DEAD   4   // caller whose server exited
+
+struct endpoint {
+  struct proc *receiver;   // waiting in ipc_reply_wait()
+  struct proc *senders;    // callers queued for a receiver
+  struct proc **tail;
+  struct pollhead poll;    // woken when a caller queues
+};
+
+// protects the endpoints and every
+// process's ipc_ fields.
+static struct spinlock ipc_lock;
+
+static struct endpoint endpoints[NENDPOINT];
+
+void
+ipcinit(void)
+{
+  struct endpoint *ep;
+
+  initlock(&ipc_lock, "ipc");
+  for(ep = endpoints; ep < &endpoints[NENDPOINT]; ep++)
+    ep->tail = &ep->senders;
+}
+
+// copy a message from one process's registers to another's.
+static void
+ipc_copy(struct proc *to, struct proc *from)
+{
+  uint64 *src = &from->trapframe->a1;
+  uint64 *dst = &to->trapframe->a1;
+
+  for(int i = 0; i < NIPCMSG; i++)
+    dst[i] = src[i];
+}
+
+static void
+ipc_dequeue(struct endpoint *ep, struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &ep->senders; *pp; pp = &(*pp)->ipc_next){
+    if(*pp == p){
+      *pp = p->ipc_next;
+      if(ep->tail == &p->ipc_next)
+        ep->tail = pp;
+      p->ipc_next = 0;
+      return;
+    }
+  }
+}
+
+// server s takes caller c's message.
+static void
+ipc_take(struct proc *s, struct proc *c)
+{
+  ipc_copy(s, c);
+  s->ipc_client = c;
+  c->ipc_server = s;
+  c->ipc_state = IPC_REPLY;
+}
+
+// send the calling process's message to endpoint ep and
+// wait for the reply, which replaces it in a1..a4.
+// returns 0, or -EINVAL, -EINTR, or -EPIPE if the server
+// exited without replying.
+static int
+ipc_call(int ep)
+{
+  struct proc *p = myproc();
+  struct endpoint *e = &endpoints[ep];
+  struct proc *r;
+  int ret;
+
+  acquire(&ipc_lock);
+  if((r = e->receiver) != 0){
+    // the fast path: a server is waiting.
+    e->receiver = 0;
+    r->ipc_state = IPC_NONE;
+    ipc_take(r, p);
+    sleep_handoff(&p->ipc_state, &ipc_lock, r, &r->ipc_state);
+  } else {
+    p->ipc_state = IPC_SEND;
+    p->ipc_next = 0;
+    *e->tail = p;
+    e->tail = &p->ipc_next;
+    pollwake(&e->poll, EPOLLIN);
+  }
+
+  while(p->ipc_state == IPC_SEND || p->ipc_state == IPC_REPLY){
+    if(p->killed){
+      if(p->ipc_state == IPC_SEND)
+        ipc_dequeue(e, p);
+      else if(p->ipc_server->ipc_client == p)
+        p->ipc_server->ipc_client = 0;
+      p->ipc_state = IPC_NONE;
+      release(&ipc_lock);
+      return -EINTR;
+    }
+    sleep(&p->ipc_state, &ipc_lock);
+  }
+
+  ret = p->ipc_state == IPC_DEAD ? -EPIPE : 0;
+  p->ipc_state = IPC_NONE;
+  p->ipc_server = 0;
+  release(&ipc_lock);
+  return ret;
+}
+
+// reply with the calling process's message to its
+// current client, if any. returns the client, made
+// ready but not yet woken. caller holds ipc_lock.
+static struct proc*
+ipc_answer(struct proc *p)
+{
+  struct proc *c;
+
+  if((c = p->ipc_client) == 0)
+    return 0;
+  p->ipc_client = 0;
+  ipc_copy(c, p);
+  c->ipc_state = IPC_NONE;
+  return c;
+}
+
+// reply to the current client, if any, then wait for
+// the next message on endpoint ep, which arrives in
+// a1..a4. returns 0, or -EBUSY if another process is
+// already receiving on ep, or -EINTR.
+static int
+ipc_reply_wait(int ep)
+{
+  struct proc *p = myproc();
+  struct endpoint *e = &endpoints[ep];
+  struct proc *c, *s;
+
+  acquire(&ipc_lock);
+  c = ipc_answer(p);
+
+  // a caller is already queued: take its message
+  // and let the old client run wherever it can.
+  if((s = e->senders) != 0){
+    if((e->senders = s->ipc_next) == 0)
+      e->tail = &e->senders;
+    s->ipc_next = 0;
+    ipc_take(p, s);
+    release(&ipc_lock);
+    if(c)
+      wakeup_proc(c, &c->ipc_state);
+    return 0;
+  }
+
+  if(e->receiver != 0){
+    release(&ipc_lock);
+    if(c)
+      wakeup_proc(c, &c->ipc_state);
+    return -EBUSY;
+  }
+  e->receiver = p;
+  p->ipc_state = IPC_RECV;
+
+  // the fast path: switch straight back to the client,
+  // which will most likely call again.
+  if(c)
+    sleep_handoff(&p->ipc_state, &ipc_lock, c, &c->ipc_state);
+
+  while(p->ipc_state == IPC_RECV){
+    if(p->killed){
+      e->receiver = 0;
+      p->ipc_state = IPC_NONE;
+      release(&ipc_lock);
+      return -EINTR;
+    }
+    sleep(&p->ipc_state, &ipc_lock);
+  }
+  release(&ipc_lock);
+  return 0;
+}
+
+// called by exit(): fail the call of any client
+// still waiting for our reply.
+void
+ipc_exit(struct proc *p)
+{
+  struct proc *c;
+
+  acquire(&ipc_lock);
+  if((c = p->ipc_client) != 0){
+    p->ipc_client = 0;
+    c->ipc_state = IPC_DEAD;
+    wakeup(&c->ipc_state);
+  }
+  release(&ipc_lock);
+}
+
+// an endpoint is readable while callers are queued
+// on it, waiting for a server to receive.
+int
+ipc_poll(int ep)
+{
+  int events;
+
+  acquire(&ipc_lock);
+  events = endpoints[ep].senders ? EPOLLIN : 0;
+  release(&ipc_lock);
+  return events;
+}
+
+struct pollhead*
+ipc_pollhead(int ep)
+{
+  return &endpoints[ep].poll;
+}
+
+static int
+argep(int n, int *ep)
+{
+  argint(n, ep);
+  if(*ep < 0 || *ep >= NENDPOINT)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_ipc_call(void)
+{
+  int ep;
+
+  if(argep(0, &ep) < 0)
+    return -EINVAL;
+  return ipc_call(ep);
+}
+
+uint64
+sys_ipc_reply(void)
+{
+  struct proc *c;
+
+  acquire(&ipc_lock);
+  c = ipc_answer(myproc());
+  release(&ipc_lock);
+  if(c == 0)
+    return -EINVAL;
+  wakeup_proc(c, &c->ipc_state);
+  return 0;
+}
+
+uint64
+sys_ipc_reply_wait(void)
+{
+  int ep;
+
+  if(argep(0, &ep) < 0)
+    return -EINVAL;
+  return ipc_reply_wait(ep);
+}
+
+// ipc_open(ep): a file for endpoint ep, so that a server
+// can wait for callers through an eventpoll.
+uint64
+sys_ipc_open(void)
+{
+  struct file *f;
+  int ep, fd;
+
+  if(argep(0, &ep) < 0)
+    return -EINVAL;
+  if((f = filealloc()) == 0)
+    return -ENOMEM;
+  f->type = FD_ENDPOINT;
+  f->readable = 1;
+  f->writable = 0;
+  f->endpoint = ep;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
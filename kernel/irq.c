@@ -0,0 +1,252 @@
+//
+// device interrupt routing and accounting.
+//
+// the interrupt controller is the PLIC, or with AIA=1 the
+// APLIC and IMSICs; irqinit() picks the back end (intc.h).
+//
+// each device IRQ has an affinity mask of the harts the
+// controller may deliver it to. by default every IRQ goes
+// to exactly one hart, spread round-robin over the harts
+// that are up, so an interrupt no longer races to every hart
+// and leaves the losers with a spurious claim.
+//
+// devintr() counts interrupts per hart and per IRQ, and
+// irqbalance() uses those counts to move busy IRQs off
+// overloaded harts.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "intc.h"
+#include "defs.h"
+
+// how often irqbalance() looks at the counters, in ticks.
+#define BALANCE_INTERVAL 10
+
+// don't bother moving IRQs for fewer interrupts
+// than this per interval.
+#define BALANCE_THRESHOLD 100
+
+// the device IRQs the kernel handles.
+static int devirqs[] = { UART0_IRQ, VIRTIO0_IRQ };
+
+struct intc *intc;
+
+static struct {
+  struct spinlock lock;
+  uint affinity[NIRQ];  // bitmap of harts that may take each IRQ
+  uint online;          // bitmap of harts that called irqinithart()
+} irqs;
+
+// per-hart statistics. each hart only writes its own row.
+static uint64 irq_count[NCPU][NIRQ];
+static uint64 irq_spurious[NCPU];   // claims that found nothing
+static uint64 irq_hold_total[NCPU]; // cycles with the claim held
+static uint64 irq_hold_max[NCPU];
+
+// irq_count[][] as of the last irqbalance().
+static uint64 irq_last[NCPU][NIRQ];
+static uint balance_last;
+
+// pick and set up the interrupt controller.
+// called once, on hart 0.
+void
+irqinit(void)
+{
+  initlock(&irqs.lock, "irqs");
+#ifdef AIA
+  intc = &imsic_intc;
+#else
+  intc = &plic_intc;
+#endif
+  intc->init();
+}
+
+// tell the controller where each IRQ may go.
+// caller must hold irqs.lock.
+static void
+irq_program(void)
+{
+  int i;
+
+  for(i = 0; i < NELEM(devirqs); i++)
+    intc->route(devirqs[i], irqs.affinity[devirqs[i]] & irqs.online);
+}
+
+// the n'th online hart, counting from 0 and wrapping.
+// caller must hold irqs.lock.
+static int
+irq_nthonline(int n)
+{
+  int hart, k;
+
+  k = 0;
+  for(hart = 0; hart < NCPU; hart++)
+    if(irqs.online & (1 << hart))
+      k++;
+  n %= k;
+  for(hart = 0; hart < NCPU; hart++){
+    if((irqs.online & (1 << hart)) && n-- == 0)
+      return hart;
+  }
+  panic("irq_nthonline");
+}
+
+// called by each hart once it can take interrupts.
+// spreads the device IRQs over the harts up so far.
+void
+irqinithart(void)
+{
+  int i;
+
+  intc->inithart();
+
+  acquire(&irqs.lock);
+  irqs.online |= 1 << cpuid();
+  for(i = 0; i < NELEM(devirqs); i++)
+    irqs.affinity[devirqs[i]] = 1 << irq_nthonline(i);
+  irq_program();
+  release(&irqs.lock);
+}
+
+// the bitmap of harts that are up.
+uint
+irq_online(void)
+{
+  return irqs.online;
+}
+
+// route irq to the harts in mask.
+// returns -1 if none of them is online.
+int
+irq_set_affinity(int irq, uint mask)
+{
+  if(irq <= 0 || irq >= NIRQ)
+    return -1;
+
+  acquire(&irqs.lock);
+  if((mask & irqs.online) == 0){
+    release(&irqs.lock);
+    return -1;
+  }
+  irqs.affinity[irq] = mask & irqs.online;
+  irq_program();
+  release(&irqs.lock);
+  return 0;
+}
+
+// account for one external interrupt on this hart. irq is
+// what the claim returned (0 if another hart got there first),
+// held is how long the claim was held, in cycles.
+// called from devintr() with interrupts off.
+void
+irqstat(int irq, uint64 held)
+{
+  int id = cpuid();
+
+  if(irq == 0){
+    irq_spurious[id]++;
+    return;
+  }
+  if(irq < NIRQ)
+    irq_count[id][irq]++;
+  irq_hold_total[id] += held;
+  if(held > irq_hold_max[id])
+    irq_hold_max[id] = held;
+}
+
+// move one IRQ from the hart that took the most interrupts
+// since the last call to the one that took the fewest, if
+// that narrows the gap. called from the timer softirq.
+void
+irqbalance(void)
+{
+  uint64 load[NCPU], delta[NIRQ];
+  int hart, busy, idle, i, irq, best;
+
+  if(ticks - balance_last < BALANCE_INTERVAL)
+    return;
+  balance_last = ticks;
+
+  acquire(&irqs.lock);
+
+  // interrupts each hart and each IRQ took this interval.
+  for(irq = 0; irq < NIRQ; irq++)
+    delta[irq] = 0;
+  busy = idle = -1;
+  for(hart = 0; hart < NCPU; hart++){
+    load[hart] = 0;
+    if((irqs.online & (1 << hart)) == 0)
+      continue;
+    for(i = 0; i < NELEM(devirqs); i++){
+      irq = devirqs[i];
+      uint64 n = irq_count[hart][irq] - irq_last[hart][irq];
+      irq_last[hart][irq] = irq_count[hart][irq];
+      load[hart] += n;
+      delta[irq] += n;
+    }
+    if(busy < 0 || load[hart] > load[busy])
+      busy = hart;
+    if(idle < 0 || load[hart] < load[idle])
+      idle = hart;
+  }
+
+  if(busy < 0 || busy == idle || load[busy] - load[idle] < BALANCE_THRESHOLD){
+    release(&irqs.lock);
+    return;
+  }
+
+  // the busiest IRQ routed only to busy whose move
+  // leaves the pair less unbalanced than before.
+  best = -1;
+  for(i = 0; i < NELEM(devirqs); i++){
+    irq = devirqs[i];
+    if(irqs.affinity[irq] != (1 << busy))
+      continue;
+    if(delta[irq] == 0 || delta[irq] >= load[busy] - load[idle])
+      continue;
+    if(best < 0 || delta[irq] > delta[best])
+      best = irq;
+  }
+  if(best > 0){
+    irqs.affinity[best] = 1 << idle;
+    irq_program();
+  }
+
+  release(&irqs.lock);
+}
+
+// print per-hart interrupt statistics.
+// runs when user types ^T on console.
+void
+intrdump(void)
+{
+  int hart, i, irq;
+  uint64 n;
+
+  printf("\n");
+  for(i = 0; i < NELEM(devirqs); i++){
+    irq = devirqs[i];
+    printf("irq %d affinity %x:", irq, irqs.affinity[irq]);
+    for(hart = 0; hart < NCPU; hart++)
+      if(irqs.online & (1 << hart))
+        printf(" %d", (int)irq_count[hart][irq]);
+    printf("\n");
+  }
+  for(hart = 0; hart < NCPU; hart++){
+    if((irqs.online & (1 << hart)) == 0)
+      continue;
+    n = 0;
+    for(i = 0; i < NELEM(devirqs); i++)
+      n += irq_count[hart][devirqs[i]];
+    printf("hart %d irqs %d spurious %d hold avg %d max %d cycles\n",
+           hart, (int)n, (int)irq_spurious[hart],
+           n ? (int)(irq_hold_total[hart] / n) : 0,
+           (int)irq_hold_max[hart]);
+  }
+  softirqdump();
+}
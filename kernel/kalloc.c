@@ -1,6 +1,15 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+//
+// Pages are reference counted, so that one page can be
+// mapped into several address spaces (see shm.c): kalloc()
+// returns a page with one reference, kref() adds one, and
+// kfree() drops one, freeing the page when none are left.
+//
+// The top NCONTIG pages of RAM are kept out of the free list
+// for kalloc_contig(), which hands out physically contiguous
+// runs of pages.
 
 #include "types.h"
 #include "param.h"
@@ -14,6 +23,11 @@ void freerange(void *pa_start, void *pa_end);
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+#define NCONTIG 512  // pages in the contiguous pool
+#define CONTIGBASE (PHYSTOP - NCONTIG*PGSIZE)
+
+#define PA2REF(pa) ((((uint64)(pa)) - KERNBASE) / PGSIZE)
+
 struct run {
   struct run *next;
 };
@@ -21,13 +35,15 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
+  ushort ref[(PHYSTOP - KERNBASE) / PGSIZE];
+  char contig_used[NCONTIG];
 } kmem;
 
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
-  freerange(end, (void*)PHYSTOP);
+  freerange(end, (void*)CONTIGBASE);
 }
 
 void
@@ -35,14 +51,17 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    kmem.ref[PA2REF(p)] = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by pa, which normally should have been returned by a
+// call to kalloc() or kalloc_contig(), and free it if that
+// was the last.  (The exception is when initializing the
+// allocator; see kinit above.)
 void
 kfree(void *pa)
 {
@@ -51,14 +70,26 @@ kfree(void *pa)
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  acquire(&kmem.lock);
+  if(kmem.ref[PA2REF(pa)] == 0)
+    panic("kfree: free");
+  if(--kmem.ref[PA2REF(pa)] > 0){
+    release(&kmem.lock);
+    return;
+  }
+  release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
-  r = (struct run*)pa;
-
   acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  if((uint64)pa >= CONTIGBASE){
+    kmem.contig_used[((uint64)pa - CONTIGBASE) / PGSIZE] = 0;
+  } else {
+    r = (struct run*)pa;
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+  }
   release(&kmem.lock);
 }
 
@@ -72,11 +103,70 @@ kalloc(void)
 
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.ref[PA2REF(r)] = 1;
+  }
   release(&kmem.lock);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
   return (void*)r;
 }
+
+// Allocate n physically contiguous pages, each with one
+// reference, to be freed one by one with kfree().
+// Returns 0 if there is no run that long.
+void *
+kalloc_contig(int n)
+{
+  int i, j;
+  char *pa;
+
+  acquire(&kmem.lock);
+  for(i = 0; i + n <= NCONTIG; i = j + 1){
+    for(j = i; j < i + n && !kmem.contig_used[j]; j++)
+      ;
+    if(j == i + n)
+      goto found;
+  }
+  release(&kmem.lock);
+  return 0;
+
+found:
+  pa = (char*)CONTIGBASE + i*PGSIZE;
+  for(j = i; j < i + n; j++){
+    kmem.contig_used[j] = 1;
+    kmem.ref[PA2REF(pa + (j-i)*PGSIZE)] = 1;
+  }
+  release(&kmem.lock);
+
+  memset(pa, 5, n*PGSIZE); // fill with junk
+  return pa;
+}
+
+// Add a reference to the page at pa.
+void
+kref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kref");
+
+  acquire(&kmem.lock);
+  if(kmem.ref[PA2REF(pa)] == 0)
+    panic("kref: free");
+  kmem.ref[PA2REF(pa)]++;
+  release(&kmem.lock);
+}
+
+// The number of references to the page at pa.
+int
+krefcount(void *pa)
+{
+  int n;
+
+  acquire(&kmem.lock);
+  n = kmem.ref[PA2REF(pa)];
+  release(&kmem.lock);
+  return n;
+}
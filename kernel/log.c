@@ -0,0 +1,411 @@
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "blk.h"
+#include "buf.h"
+
+// Simple logging that allows concurrent FS system calls.
+//
+// A log transaction contains the updates of multiple FS system
+// calls. The logging system only commits when there are
+// no FS system calls active. Thus there is never
+// any reasoning required about whether a commit might
+// write an uncommitted system call's updates to disk.
+//
+// A system call should call begin_op()/end_op() to mark
+// its start and end. Usually begin_op() just increments
+// the count of in-progress FS system calls and returns.
+// But if it thinks the log is close to running out, it
+// sleeps until the last outstanding end_op() commits.
+//
+// Commits are group commits, done by the log thread, logd:
+// end_op() doesn't wait for one, so a system call returns
+// as soon as its updates are in the open transaction. Once
+// no system call is in the middle of one, logd takes the
+// transaction, and new system calls start the next while it
+// writes this one out, so under load each commit carries
+// the updates of all the calls that arrived during the last.
+// A block written again before its transaction commits is
+// logged once. log_force() waits for everything so far to
+// be committed, for fsync().
+//
+// The log is a physical re-do log containing disk blocks,
+// in two halves that commits take turns to use. Each half is
+// a header block, containing block numbers for blocks A, B,
+// C, ..., followed by the logged copies of those blocks. The
+// header carries the transaction's sequence number and a
+// CRC32C of the header and the logged blocks, so the header
+// and blocks can all be written at once: recovery ignores a
+// half whose checksum doesn't match, since the commit never
+// finished. A commit thus costs one wait and one cache flush,
+// the barrier, before the blocks can be installed in their
+// home locations. The halves alternate so that a commit
+// never overwrites the last one's log until the next barrier
+// has made its installed blocks durable.
+
+// blocks a transaction can log: a half of the log,
+// less its header.
+#define LOGTXN (LOGSIZE/2 - 1)
+
+// Contents of the header block, used for both the on-disk header block
+// and to keep track in memory of logged block# before commit.
+struct logheader {
+  uint seq;   // transaction number; 0 if none
+  uint n;     // blocks logged
+  uint crc;   // CRC32C of the header, with crc 0, and the blocks
+  uint block[LOGTXN];
+};
+
+struct log {
+  struct spinlock lock;
+  int start;
+  int dev;
+  int outstanding; // how many FS sys calls are executing.
+  int committing;  // logd is taking the transaction; wait.
+  uint seq;        // the open transaction
+  uint done;       // the last committed transaction
+  int half;        // the half of the log the next commit uses
+  struct logheader lh;
+  struct buf *bufs[LOGTXN]; // the cached blocks in lh, pinned
+
+  uint64 ncommit, nlogged, nops, nabsorb;
+};
+struct log log;
+
+// a transaction while logd writes it out: its header in
+// blk[0], and copies of its blocks in blk[1..n], which go to
+// the log and then their home locations. taken as a snapshot
+// so that the system calls of the next transaction can
+// change the cached blocks meanwhile.
+static struct {
+  uchar blk[LOGTXN+1][BSIZE];
+  struct buf *bufs[LOGTXN];
+  struct blkreq reqs[LOGTXN+1];
+} commitlog __attribute__ ((aligned (PGSIZE)));
+
+static void recover_from_log(void);
+static void logthread(void*);
+
+// CRC32C (Castagnoli), byte at a time.
+static uint crctab[256];
+
+static void
+crcinit(void)
+{
+  uint c;
+  int i, j;
+
+  for(i = 0; i < 256; i++){
+    c = i;
+    for(j = 0; j < 8; j++)
+      c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+    crctab[i] = c;
+  }
+}
+
+static uint
+crc32c(uint crc, uchar *p, int n)
+{
+  crc = ~crc;
+  while(n-- > 0)
+    crc = crctab[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+// the checksum of the header in blk[0], taken with its crc
+// field 0, and the n blocks after it.
+static uint
+logcrc(uchar (*blk)[BSIZE], int n)
+{
+  struct logheader *lh = (struct logheader*)blk[0];
+  uint crc, saved;
+  int i;
+
+  saved = lh->crc;
+  lh->crc = 0;
+  crc = crc32c(0, blk[0], BSIZE);
+  lh->crc = saved;
+  for(i = 1; i <= n; i++)
+    crc = crc32c(crc, blk[i], BSIZE);
+  return crc;
+}
+
+void
+initlog(int dev, struct superblock *sb)
+{
+  if (sizeof(struct logheader) >= BSIZE)
+    panic("initlog: too big logheader");
+  if(sb->nlog < LOGSIZE)
+    panic("initlog: log too small");
+  // the open transaction and the one logd is writing out
+  // can pin up to LOGSIZE-2 buffers between them.
+  if(NBUF < 2 * LOGSIZE)
+    panic("initlog: NBUF too small for the log");
+
+  initlock(&log.lock, "log");
+  crcinit();
+  log.start = sb->logstart;
+  log.dev = dev;
+  recover_from_log();
+  if(kthread_create(logthread, 0, "logd", -1) == 0)
+    panic("initlog");
+}
+
+// Write each of the n blocks in data to the disk block in
+// blocks, merging neighbours into one request, and wait
+// for them all.
+static void
+write_blocks(uint *blocks, uchar (*data)[BSIZE], int n)
+{
+  struct blkreq *r, *reqs[LOGTXN+1];
+  int i, nreq;
+
+  r = 0;
+  nreq = 0;
+  for(i = 0; i < n; i++){
+    if(r == 0 || r->nseg == BLKMAXSEG || blocks[i-1] + 1 != blocks[i]){
+      r = &commitlog.reqs[nreq];
+      reqs[nreq++] = r;
+      r->write = 1;
+      r->sector = (uint64)blocks[i] * (BSIZE / BLKSECT);
+      r->nseg = 0;
+      r->done = 0;
+    }
+    r->seg[r->nseg].addr = data[i];
+    r->seg[r->nseg].len = BSIZE;
+    r->nseg++;
+  }
+  if(nreq == 0)
+    return;
+  virtio_disk_submit(reqs, nreq);
+  for(i = 0; i < nreq; i++)
+    if(blk_wait(reqs[i]) < 0)
+      panic("log: write");
+}
+
+// Read half h of the log into commitlog.blk. returns its
+// transaction's sequence number if it's committed, or 0.
+static uint
+read_half(int h)
+{
+  struct logheader *lh = (struct logheader*)commitlog.blk[0];
+  struct buf *buf;
+  int i, start;
+
+  start = log.start + h * (LOGSIZE/2);
+  buf = bread(log.dev, start);
+  memmove(commitlog.blk[0], buf->data, BSIZE);
+  brelse(buf);
+  if(lh->seq == 0 || lh->n == 0 || lh->n > LOGTXN)
+    return 0;
+  for(i = 1; i <= lh->n; i++){
+    buf = bread(log.dev, start + i);
+    memmove(commitlog.blk[i], buf->data, BSIZE);
+    brelse(buf);
+  }
+  if(logcrc(commitlog.blk, lh->n) != lh->crc)
+    return 0;
+  return lh->seq;
+}
+
+// Replay the committed transactions in the log, oldest first.
+// Replaying one that was already installed does no harm.
+static void
+recover_from_log(void)
+{
+  struct logheader *lh = (struct logheader*)commitlog.blk[0];
+  uint seq[2];
+  int h, i, latest, n;
+
+  seq[0] = read_half(0);
+  seq[1] = read_half(1);
+  latest = seq[1] > seq[0];
+  n = 0;
+  for(i = 1; i >= 0; i--){
+    h = latest ^ i;
+    if(seq[h] == 0)
+      continue;
+    read_half(h);
+    write_blocks(lh->block, commitlog.blk + 1, lh->n);
+    n++;
+  }
+  if(n > 0 && virtio_disk_flush() < 0)
+    panic("log: flush");
+
+  log.done = seq[latest];
+  log.seq = log.done + 1;
+  log.half = latest ^ 1;
+  if(n > 0)
+    printf("log: replayed %d transactions\n", n);
+}
+
+// called at the start of each FS system call.
+void
+begin_op(void)
+{
+  acquire(&log.lock);
+  while(1){
+    if(log.committing){
+      sleep(&log, &log.lock);
+    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGTXN){
+      // this op might exhaust log space; wait for commit.
+      sleep(&log, &log.lock);
+    } else {
+      log.outstanding += 1;
+      log.nops++;
+      release(&log.lock);
+      break;
+    }
+  }
+}
+
+// called at the end of each FS system call.
+// hands the transaction to logd if this was the last
+// outstanding operation, without waiting for the commit.
+void
+end_op(void)
+{
+  acquire(&log.lock);
+  log.outstanding -= 1;
+  if(log.committing)
+    panic("log.committing");
+  if(log.outstanding == 0)
+    wakeup(&log);
+  release(&log.lock);
+}
+
+// wait until the updates of every FS system call that has
+// finished are committed.
+void
+log_force(void)
+{
+  uint seq;
+
+  acquire(&log.lock);
+  // the open transaction if it has anything in it,
+  // or else the one being committed, if any.
+  seq = log.lh.n > 0 ? log.seq : log.seq - 1;
+  while(log.done < seq)
+    sleep(&log, &log.lock);
+  release(&log.lock);
+}
+
+// Write the transaction in commitlog to the log: its header
+// and blocks in one go, into the next half. once they're
+// written and the disk's cache flushed, it's committed.
+static void
+commit(void)
+{
+  struct logheader *lh = (struct logheader*)commitlog.blk[0];
+  uint blocks[LOGTXN+1];
+  int i, start;
+
+  start = log.start + log.half * (LOGSIZE/2);
+  for(i = 0; i <= lh->n; i++)
+    blocks[i] = start + i;
+  lh->crc = logcrc(commitlog.blk, lh->n);
+  write_blocks(blocks, commitlog.blk, lh->n + 1);
+  if(virtio_disk_flush() < 0)
+    panic("log: flush");
+}
+
+// logd: commit each transaction once no system call is in
+// the middle of it, and install its blocks.
+static void
+logthread(void *arg)
+{
+  struct logheader *lh = (struct logheader*)commitlog.blk[0];
+  int i;
+
+  for(;;){
+    acquire(&log.lock);
+    while(log.lh.n == 0 || log.outstanding > 0)
+      sleep(&log, &log.lock);
+    // none can start another system call until it's copied.
+    log.committing = 1;
+    memset(commitlog.blk[0], 0, BSIZE);
+    lh->seq = log.seq;
+    lh->n = log.lh.n;
+    memmove(lh->block, log.lh.block, lh->n * sizeof(uint));
+    memmove(commitlog.bufs, log.bufs, lh->n * sizeof(struct buf*));
+    release(&log.lock);
+
+    for(i = 0; i < lh->n; i++){
+      acquiresleep(&commitlog.bufs[i]->lock);
+      memmove(commitlog.blk[1+i], commitlog.bufs[i]->data, BSIZE);
+      releasesleep(&commitlog.bufs[i]->lock);
+    }
+
+    acquire(&log.lock);
+    log.lh.n = 0;
+    log.seq++;
+    log.committing = 0;
+    wakeup(&log);
+    release(&log.lock);
+
+    commit();
+
+    acquire(&log.lock);
+    log.done = lh->seq;
+    log.half ^= 1;
+    log.ncommit++;
+    log.nlogged += lh->n;
+    wakeup(&log);
+    release(&log.lock);
+
+    // install the blocks from the copies: the cached ones
+    // may have changes from the next transaction by now.
+    write_blocks(lh->block, commitlog.blk + 1, lh->n);
+    for(i = 0; i < lh->n; i++)
+      bunpin(commitlog.bufs[i]);
+  }
+}
+
+// Caller has modified b->data and is done with the buffer.
+// Record the block number and pin in the cache by increasing refcnt.
+// The commit will do the disk write.
+//
+// log_write() replaces bwrite(); a typical use is:
+//   bp = bread(...)
+//   modify bp->data[]
+//   log_write(bp)
+//   brelse(bp)
+void
+log_write(struct buf *b)
+{
+  int i;
+
+  acquire(&log.lock);
+  if (log.lh.n >= LOGTXN)
+    panic("too big a transaction");
+  if (log.outstanding < 1)
+    panic("log_write outside of trans");
+
+  for (i = 0; i < log.lh.n; i++) {
+    if (log.lh.block[i] == b->blockno)   // log absorption
+      break;
+  }
+  if (i == log.lh.n) {  // Add new block to log?
+    log.lh.block[i] = b->blockno;
+    log.bufs[i] = b;
+    bpin(b);
+    log.lh.n++;
+  } else
+    log.nabsorb++;
+  release(&log.lock);
+}
+
+// transactions committed, blocks they logged, FS system
+// calls, and writes absorbed since boot.
+void
+logstats(uint64 *ncommit, uint64 *nlogged, uint64 *nops, uint64 *nabsorb)
+{
+  *ncommit = log.ncommit;
+  *nlogged = log.nlogged;
+  *nops = log.nops;
+  *nabsorb = log.nabsorb;
+}
@@ -6,6 +6,18 @@
 
 volatile static int started = 0;
 
+// the first kernel thread. mounting the root file system
+// reads the disk, which needs a process to sleep in; then
+// start what runs on top of it.
+static void
+initthread(void *arg)
+{
+  fsinit(ROOTDEV);
+#ifdef BENCH
+  benchinit();     // run the benchmarks
+#endif
+}
+
 // start() jumps here in supervisor mode on all CPUs.
 void
 main()
@@ -20,10 +32,24 @@ main()
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
+    futexinit();     // futex wait queues
+    ringinit();      // system call rings
+    ipcinit();       // IPC endpoints
+    shminit();       // shared memory objects
+    binit();         // buffer cache
+    iinit();         // inode table
+    fileinit();      // file table
+    pollinit();      // eventpoll ready lists
+    timerinit();     // kernel timers
+    workqueueinit(); // per-CPU worker threads
+    softirqinit();   // interrupt bottom halves
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
-    plicinit();      // set up interrupt controller
-    plicinithart();  // ask PLIC for device interrupts
+    irqinit();       // set up interrupt controller
+    irqinithart();   // ask for some device interrupts
+    virtio_disk_init(); // emulated hard disk
+    if(kthread_create(initthread, 0, "init", -1) == 0)
+      panic("init");
     __sync_synchronize();
     started = 1;
   } else {
@@ -33,7 +59,7 @@ main()
     printf("hart %d starting\n", cpuid());
     kvminithart();    // turn on paging
     trapinithart();   // install kernel trap vector
-    plicinithart();   // ask PLIC for device interrupts
+    irqinithart();    // ask for some device interrupts
   }
 
   scheduler();        
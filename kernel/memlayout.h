@@ -29,6 +29,8 @@
 #define CLINT 0x2000000L
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define CLINT_FREQ 10000000L          // mtime cycles per second in qemu.
+#define TIMER_INTERVAL 1000000        // cycles per clock tick; about 1/10th second.
 
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
@@ -41,6 +43,20 @@
 #define PLIC_MCLAIM(hart) (PLIC + 0x200004 + (hart)*0x2000)
 #define PLIC_SCLAIM(hart) (PLIC + 0x201004 + (hart)*0x2000)
 
+// IRQ numbers the kernel keeps per-IRQ state for.
+#define NIRQ 32
+
+// with -machine virt,aia=aplic-imsic, qemu replaces the PLIC
+// with an APLIC, whose machine-level domain sits where the
+// PLIC was and delegates to a supervisor-level domain, and
+// gives each hart its own IMSIC interrupt files.
+#define APLIC_M 0x0c000000L
+#define APLIC_S 0x0d000000L
+#define APLIC_SIZE 0x8000
+#define IMSIC_M 0x24000000L
+#define IMSIC_S 0x28000000L
+#define IMSIC_S_HART(hart) (IMSIC_S + (hart)*PGSIZE)
+
 // the kernel expects there to be RAM
 // for use by the kernel and user pages
 // from physical address 0x80000000 to PHYSTOP.
@@ -62,6 +78,14 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   RING (system call rings, if set up; see ring.h)
+//   VDSO (p->vdso, read-only; see vdso.h)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define VDSO (TRAPFRAME - PGSIZE)
+#define RING (VDSO - PGSIZE)
+
+// user memory ends below the devices, which share its
+// first gigabyte of address space; see kvmcreate().
+#define USERTOP PLIC
@@ -1,3 +1,13 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
-#define NDEV         10  // maximum major device number
\ No newline at end of file
+#define NDEV         10  // maximum major device number
+#define NOFILE       16  // open files per process
+#define NFILE       100  // open files per system
+#define NINODE       50  // maximum number of active i-nodes
+#define ROOTDEV       1  // device number of file system root disk
+#define MAXOPBLOCKS  10  // max # of blocks any FS op writes
+#define LOGSIZE      (MAXOPBLOCKS*12) // blocks in on-disk log, both halves
+#define NBUF        256  // size of disk block cache; more than LOGSIZE,
+                         // which in-flight commits may pin
+#define FSSIZE    32768  // size of file system in blocks
+#define MAXPATH     128  // maximum file path name
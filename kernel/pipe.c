@@ -0,0 +1,462 @@
+//
+// pipes.
+//
+// a pipe's data lives in a ring of up to PIPEBUFS pages rather
+// than a small fixed buffer, so a writer can get well ahead of
+// its reader, and each copy moves up to a page under one lock
+// acquisition. readers and writers are woken at most once per
+// read() or write() call, and only if someone is asleep on the
+// other side, not once per byte.
+//
+// vmsplice() moves page references instead of bytes. a writer
+// gives the pipe its own pages, which become copy-on-write in
+// its address space (see uvmcow() in vm.c), and a reader takes
+// such pages straight into its address space in place of the
+// pages it had there. neither side copies anything.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
+#include "errno.h"
+
+#define PIPEBUFS 16   // pages in a pipe's ring
+
+// one page in the ring; bytes [off, len) are unread.
+struct pipebuf {
+  char *page;
+  uint off;
+  uint len;
+  int gift;           // page came from vmsplice(); don't append to it
+};
+
+struct pipe {
+  struct spinlock lock;
+  struct pipebuf bufs[PIPEBUFS];
+  uint head;          // next buffer to read, counting forever
+  uint tail;          // next buffer to fill
+  uint nbytes;        // unread bytes in all buffers
+  int nreadwait;      // readers asleep in piperead()
+  int nwritewait;     // writers asleep in pipewrite()
+  int readopen;       // read fd is still open
+  int writeopen;      // write fd is still open
+  struct pollhead poll; // eventpolls watching either end
+};
+
+int
+pipealloc(struct file **f0, struct file **f1)
+{
+  struct pipe *pi;
+
+  pi = 0;
+  *f0 = *f1 = 0;
+  if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
+    goto bad;
+  if((pi = (struct pipe*)kalloc()) == 0)
+    goto bad;
+  memset(pi, 0, sizeof(*pi));
+  pi->readopen = 1;
+  pi->writeopen = 1;
+  initlock(&pi->lock, "pipe");
+  (*f0)->type = FD_PIPE;
+  (*f0)->readable = 1;
+  (*f0)->writable = 0;
+  (*f0)->pipe = pi;
+  (*f1)->type = FD_PIPE;
+  (*f1)->readable = 0;
+  (*f1)->writable = 1;
+  (*f1)->pipe = pi;
+  return 0;
+
+ bad:
+  if(pi)
+    kfree((char*)pi);
+  if(*f0)
+    fileclose(*f0);
+  if(*f1)
+    fileclose(*f1);
+  return -1;
+}
+
+void
+pipeclose(struct pipe *pi, int writable)
+{
+  uint i;
+
+  acquire(&pi->lock);
+  if(writable){
+    pi->writeopen = 0;
+    wakeup(&pi->nreadwait);
+    pollwake(&pi->poll, EPOLLHUP);
+  } else {
+    pi->readopen = 0;
+    wakeup(&pi->nwritewait);
+    pollwake(&pi->poll, EPOLLERR);
+  }
+  if(pi->readopen == 0 && pi->writeopen == 0){
+    release(&pi->lock);
+    for(i = pi->head; i != pi->tail; i++)
+      kfree(pi->bufs[i % PIPEBUFS].page);
+    kfree((char*)pi);
+  } else
+    release(&pi->lock);
+}
+
+// the buffer to append to: the last one if it has room,
+// otherwise a new one at the tail. returns 0 if the ring
+// is full, or if there is no memory for a new page.
+static struct pipebuf*
+pipe_tailbuf(struct pipe *pi)
+{
+  struct pipebuf *b;
+
+  if(pi->tail != pi->head){
+    b = &pi->bufs[(pi->tail - 1) % PIPEBUFS];
+    if(!b->gift && b->len < PGSIZE)
+      return b;
+  }
+  if(pi->tail - pi->head == PIPEBUFS)
+    return 0;
+  b = &pi->bufs[pi->tail % PIPEBUFS];
+  if((b->page = kalloc()) == 0)
+    return 0;
+  b->off = 0;
+  b->len = 0;
+  b->gift = 0;
+  pi->tail++;
+  return b;
+}
+
+// b, at the head of the ring, has been read to the end.
+// keep it for the writer to fill again if it's the only
+// buffer, otherwise drop it.
+static void
+pipe_consumed(struct pipe *pi, struct pipebuf *b)
+{
+  if(pi->head + 1 == pi->tail && !b->gift){
+    b->off = 0;
+    b->len = 0;
+    return;
+  }
+  kfree(b->page);
+  b->page = 0;
+  pi->head++;
+}
+
+// wait until the pipe has data or no writers.
+// caller holds pi->lock.
+static int
+pipe_waitread(struct pipe *pi)
+{
+  struct proc *pr = myproc();
+
+  while(pi->nbytes == 0 && pi->writeopen){
+    if(pr->killed)
+      return -EINTR;
+    pi->nreadwait++;
+    sleep(&pi->nreadwait, &pi->lock);
+    pi->nreadwait--;
+  }
+  return 0;
+}
+
+// wait until the ring has room, letting readers at what
+// the caller has written so far. caller holds pi->lock.
+static void
+pipe_waitwrite(struct pipe *pi)
+{
+  if(pi->nreadwait)
+    wakeup(&pi->nreadwait);
+  pollwake(&pi->poll, EPOLLIN);
+  pi->nwritewait++;
+  sleep(&pi->nwritewait, &pi->lock);
+  pi->nwritewait--;
+}
+
+// copy up to n bytes from the head buffer to user addr.
+// returns the number copied, or -1 on a bad address.
+// caller holds pi->lock.
+static int
+pipe_copyout(struct pipe *pi, uint64 addr, int n)
+{
+  struct pipebuf *b = &pi->bufs[pi->head % PIPEBUFS];
+  int m;
+
+  m = b->len - b->off;
+  if(m > n)
+    m = n;
+  if(m > 0 && copy_to_user(addr, b->page + b->off, m) < 0)
+    return -1;
+  b->off += m;
+  pi->nbytes -= m;
+  if(b->off == b->len)
+    pipe_consumed(pi, b);
+  return m;
+}
+
+// copy up to n bytes from user addr to the tail buffer.
+// returns the number copied, 0 if the ring is full, or a
+// negative error. caller holds pi->lock.
+static int
+pipe_copyin(struct pipe *pi, uint64 addr, int n)
+{
+  struct pipebuf *b;
+  int m;
+
+  if((b = pipe_tailbuf(pi)) == 0)
+    return pi->tail - pi->head < PIPEBUFS ? -ENOMEM : 0;
+  m = PGSIZE - b->len;
+  if(m > n)
+    m = n;
+  if(copy_from_user(b->page + b->len, addr, m) < 0)
+    return -EFAULT;
+  b->len += m;
+  pi->nbytes += m;
+  return m;
+}
+
+int
+pipewrite(struct pipe *pi, uint64 addr, int n)
+{
+  struct proc *pr = myproc();
+  int i, m, r;
+
+  i = 0;
+  r = 0;
+  acquire(&pi->lock);
+  while(i < n){
+    if(pi->readopen == 0){
+      r = -EPIPE;
+      break;
+    }
+    if(pr->killed){
+      r = -EINTR;
+      break;
+    }
+    if((m = pipe_copyin(pi, addr + i, n - i)) < 0){
+      r = m;
+      break;
+    }
+    if(m == 0){
+      pipe_waitwrite(pi);
+      continue;
+    }
+    i += m;
+  }
+  if(i > 0 && pi->nreadwait)
+    wakeup(&pi->nreadwait);
+  if(i > 0)
+    pollwake(&pi->poll, EPOLLIN);
+  release(&pi->lock);
+
+  return i > 0 ? i : r;
+}
+
+int
+piperead(struct pipe *pi, uint64 addr, int n)
+{
+  int i, m, r;
+
+  acquire(&pi->lock);
+  if((r = pipe_waitread(pi)) < 0){
+    release(&pi->lock);
+    return r;
+  }
+  for(i = 0; i < n && pi->nbytes > 0; i += m){
+    if((m = pipe_copyout(pi, addr + i, n - i)) < 0){
+      r = -EFAULT;
+      break;
+    }
+  }
+  if(i > 0 && pi->nwritewait)
+    wakeup(&pi->nwritewait);
+  if(i > 0)
+    pollwake(&pi->poll, EPOLLOUT);
+  release(&pi->lock);
+
+  return i > 0 ? i : r;
+}
+
+// the events the read or write end of pi is ready for.
+int
+pipepoll(struct pipe *pi, int writable)
+{
+  struct pipebuf *b;
+  int events;
+
+  events = 0;
+  acquire(&pi->lock);
+  if(writable){
+    b = &pi->bufs[(pi->tail - 1) % PIPEBUFS];
+    if(pi->readopen == 0)
+      events |= EPOLLERR;
+    else if(pi->tail - pi->head < PIPEBUFS || (!b->gift && b->len < PGSIZE))
+      events |= EPOLLOUT;
+  } else {
+    if(pi->nbytes > 0)
+      events |= EPOLLIN;
+    if(pi->writeopen == 0)
+      events |= EPOLLHUP;
+  }
+  release(&pi->lock);
+  return events;
+}
+
+struct pollhead*
+pipepollhead(struct pipe *pi)
+{
+  return &pi->poll;
+}
+
+// give the pipe the n bytes of whole pages at user addr by
+// reference. the caller's pages become copy-on-write, so its
+// later stores don't show through the pipe. anything not
+// page-aligned is copied, as by write(), and so are shared
+// memory pages, which must stay shared.
+int
+pipe_vmsplice_write(struct pipe *pi, uint64 addr, int n)
+{
+  struct proc *pr = myproc();
+  struct pipebuf *b;
+  pte_t *pte;
+  uint64 va;
+  int i, m, r;
+
+  if(addr % PGSIZE || n % PGSIZE)
+    return pipewrite(pi, addr, n);
+
+  i = 0;
+  r = 0;
+  acquire(&pi->lock);
+  while(i < n){
+    if(pi->readopen == 0){
+      r = -EPIPE;
+      break;
+    }
+    if(pr->killed){
+      r = -EINTR;
+      break;
+    }
+    if(pi->tail - pi->head == PIPEBUFS){
+      pipe_waitwrite(pi);
+      continue;
+    }
+    va = addr + i;
+    if(va >= USERTOP || (pte = walk(pr->pagetable, va, 0)) == 0 ||
+       (*pte & (PTE_V|PTE_U|PTE_R)) != (PTE_V|PTE_U|PTE_R)){
+      r = -EFAULT;
+      break;
+    }
+    // copy the rest of a shared memory page, or of one
+    // that didn't all fit in the last buffer.
+    if((*pte & PTE_SHM) || i % PGSIZE){
+      if((m = pipe_copyin(pi, va, PGSIZE - i % PGSIZE)) < 0){
+        r = m;
+        break;
+      }
+      if(m == 0)
+        pipe_waitwrite(pi);
+      i += m;
+      continue;
+    }
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
+    b = &pi->bufs[pi->tail % PIPEBUFS];
+    b->page = (char*)PTE2PA(*pte);
+    b->off = 0;
+    b->len = PGSIZE;
+    b->gift = 1;
+    kref(b->page);
+    pi->tail++;
+    pi->nbytes += PGSIZE;
+    i += PGSIZE;
+  }
+  // drop writable TLB entries before the caller can
+  // store to the pages again.
+  if(i > 0)
+    sfence_vma();
+  if(i > 0 && pi->nreadwait)
+    wakeup(&pi->nreadwait);
+  if(i > 0)
+    pollwake(&pi->poll, EPOLLIN);
+  release(&pi->lock);
+
+  return i > 0 ? i : r;
+}
+
+// read up to n bytes into whole pages at user addr. full
+// pages that a writer gave with vmsplice() are mapped at addr
+// in place of what was there, copy-on-write; anything else is
+// copied, as by read(), and so is anything read into shared
+// memory, which must stay shared.
+int
+pipe_vmsplice_read(struct pipe *pi, uint64 addr, int n)
+{
+  struct proc *pr = myproc();
+  struct pipebuf *b;
+  pte_t *pte;
+  uint64 va, old;
+  int i, m, r, flags, remapped;
+
+  if(addr % PGSIZE || n % PGSIZE)
+    return piperead(pi, addr, n);
+
+  acquire(&pi->lock);
+  if((r = pipe_waitread(pi)) < 0){
+    release(&pi->lock);
+    return r;
+  }
+  remapped = 0;
+  for(i = 0; i < n && pi->nbytes > 0; i += m){
+    b = &pi->bufs[pi->head % PIPEBUFS];
+    va = addr + i;
+    if(b->off != 0 || b->len != PGSIZE || va % PGSIZE){
+      if((m = pipe_copyout(pi, va, n - i)) < 0){
+        r = -EFAULT;
+        break;
+      }
+      continue;
+    }
+    // the destination must be writable by the caller.
+    if(va >= USERTOP || (pte = walk(pr->pagetable, va, 0)) == 0 ||
+       (*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U) ||
+       (*pte & (PTE_W|PTE_COW)) == 0){
+      r = -EFAULT;
+      break;
+    }
+    if(*pte & PTE_SHM){
+      if((m = pipe_copyout(pi, va, n - i)) < 0){
+        r = -EFAULT;
+        break;
+      }
+      continue;
+    }
+    // the pipe's reference to the page moves to the mapping.
+    old = PTE2PA(*pte);
+    flags = (PTE_FLAGS(*pte) & ~PTE_W) | PTE_COW;
+    *pte = PA2PTE(b->page) | flags;
+    kfree((void*)old);
+    b->page = 0;
+    pi->head++;
+    pi->nbytes -= PGSIZE;
+    m = PGSIZE;
+    remapped = 1;
+  }
+  if(remapped)
+    sfence_vma();
+  if(i > 0 && pi->nwritewait)
+    wakeup(&pi->nwritewait);
+  if(i > 0)
+    pollwake(&pi->poll, EPOLLOUT);
+  release(&pi->lock);
+
+  return i > 0 ? i : r;
+}
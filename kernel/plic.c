@@ -2,12 +2,16 @@
 #include "param.h"
 #include "memlayout.h"
 #include "riscv.h"
+#include "intc.h"
 #include "defs.h"
 
 //
 // the riscv Platform Level Interrupt Controller (PLIC).
 //
 
+// each hart's S-mode enable bits, as last written.
+static uint32 plic_senable[NCPU];
+
 void
 plicinit(void)
 {
@@ -21,14 +25,35 @@ plicinithart(void)
 {
   int hart = cpuid();
   
-  // set enable bits for this hart's S-mode
-  // for the uart and virtio disk.
-  *(uint32*)PLIC_SENABLE(hart) = (1 << UART0_IRQ) | (1 << VIRTIO0_IRQ);
+  // irq.c decides which IRQs this hart's S-mode
+  // takes, through plic_route(); until then, none.
+  plic_senable[hart] = 0;
+  *(uint32*)PLIC_SENABLE(hart) = 0;
 
   // set this hart's S-mode priority threshold to 0.
   *(uint32*)PLIC_SPRIORITY(hart) = 0;
 }
 
+// enable irq in the S-mode context of the harts in
+// the harts bitmap, and disable it everywhere else.
+// irq.c serializes calls.
+void
+plic_route(int irq, uint harts)
+{
+  uint32 enable;
+  int hart;
+
+  for(hart = 0; hart < NCPU; hart++){
+    enable = plic_senable[hart] & ~(1 << irq);
+    if(harts & (1 << hart))
+      enable |= 1 << irq;
+    if(enable != plic_senable[hart]){
+      plic_senable[hart] = enable;
+      *(uint32*)PLIC_SENABLE(hart) = enable;
+    }
+  }
+}
+
 // ask the PLIC what interrupt we should serve.
 int
 plic_claim(void)
@@ -45,3 +70,12 @@ plic_complete(int irq)
   int hart = cpuid();
   *(uint32*)PLIC_SCLAIM(hart) = irq;
 }
+
+struct intc plic_intc = {
+  .name = "plic",
+  .init = plicinit,
+  .inithart = plicinithart,
+  .claim = plic_claim,
+  .complete = plic_complete,
+  .route = plic_route,
+};
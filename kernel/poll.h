@@ -0,0 +1,35 @@
+//
+// readiness notification for eventpoll.c.
+//
+// a source of events (a pipe, the console, a timer, an IPC
+// endpoint) embeds a pollhead, and calls pollwake() on it,
+// with its own lock held, whenever it becomes ready. that
+// puts each interested epitem on its eventpoll's ready list,
+// so epoll_wait() only looks at sources that have something
+// to report, however many are registered.
+//
+
+// epoll_event.events bits.
+#define EPOLLIN   0x001  // readable
+#define EPOLLOUT  0x004  // writable
+#define EPOLLERR  0x008  // error; always reported
+#define EPOLLHUP  0x010  // other end closed; always reported
+#define EPOLLET   (1U << 31) // report once per pollwake(), not while ready
+
+// epoll_ctl() operations.
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+// what epoll_ctl() takes and epoll_wait() returns.
+struct epoll_event {
+  uint32 events;
+  uint32 pad;
+  uint64 data;       // the caller's, passed back
+};
+
+struct epitem;
+
+struct pollhead {
+  struct epitem *items;  // registered interest, linked by hnext
+};
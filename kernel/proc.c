@@ -18,6 +18,12 @@ struct spinlock pid_lock;
 
 extern char trampoline[]; // trampoline.S
 
+static void kthread_start(void);
+static void loadkpagetable(struct proc *p);
+static void handoff_done(void);
+void forkret(void);
+static void freeproc(struct proc *p);
+
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
 // memory model when using p->parent.
@@ -35,8 +41,260 @@ procinit(void)
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
+#ifdef GLOBALKVM
+      // user page tables map the direct map but not
+      // KSTACK(), so use the stack where kalloc() put it.
+      if((p->kstack = (uint64)kalloc()) == 0)
+        panic("procinit");
+#else
       p->kstack = KSTACK((int) (p - proc));
+#endif
+  }
+}
+
+int
+allocpid()
+{
+  int pid;
+  
+  acquire(&pid_lock);
+  pid = nextpid;
+  nextpid = nextpid + 1;
+  release(&pid_lock);
+
+  return pid;
+}
+
+// Look in the process table for an UNUSED proc.
+// If found, initialize state required to run in the kernel,
+// and return with p->lock held.
+// If there are no free procs, return 0.
+static struct proc*
+allocproc(void)
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++) {
+    acquire(&p->lock);
+    if(p->state == UNUSED) {
+      goto found;
+    } else {
+      release(&p->lock);
+    }
+  }
+  return 0;
+
+found:
+  p->pid = allocpid();
+  p->state = USED;
+  p->affinity = -1;
+
+  // Set up new context to start executing at kthread_start.
+  memset(&p->context, 0, sizeof(p->context));
+  p->context.ra = (uint64)kthread_start;
+  p->context.sp = p->kstack + PGSIZE;
+
+  return p;
+}
+
+// free a proc structure and the data hanging from it,
+// including user pages.
+// p->lock must be held.
+static void
+freeproc(struct proc *p)
+{
+  if(p->trapframe)
+    kfree((void*)p->trapframe);
+  p->trapframe = 0;
+  if(p->vdso)
+    kfree((void*)p->vdso);
+  p->vdso = 0;
+  if(p->pagetable){
+    ring_free(p);
+    shm_free(p);
   }
+  if(p->kpagetable)
+    kvmfree(p->kpagetable);
+  p->kpagetable = 0;
+  if(p->pagetable)
+    proc_freepagetable(p->pagetable, p->sz);
+  p->pagetable = 0;
+  p->sz = 0;
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->chan = 0;
+  p->killed = 0;
+  p->xstate = 0;
+  p->kfn = 0;
+  p->karg = 0;
+  p->ipc_state = 0;
+  p->ipc_next = 0;
+  p->ipc_client = 0;
+  p->ipc_server = 0;
+  p->state = UNUSED;
+}
+
+// Create a user page table for a given process, with no user memory,
+// but with trampoline and trapframe pages, and the page table
+// the kernel uses while serving it in p->kpagetable.
+pagetable_t
+proc_pagetable(struct proc *p)
+{
+  pagetable_t pagetable;
+
+  // An empty page table.
+  pagetable = uvmcreate();
+  if(pagetable == 0)
+    return 0;
+
+  // map the trampoline code (for system call return)
+  // at the highest user virtual address.
+  // only the supervisor uses it, on the way
+  // to/from user space, so not PTE_U.
+  if(mappages(pagetable, TRAMPOLINE, PGSIZE,
+              (uint64)trampoline, PTE_R | PTE_X) < 0){
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
+  // map the trapframe page just below the trampoline page, for
+  // trampoline.S.
+  if(mappages(pagetable, TRAPFRAME, PGSIZE,
+              (uint64)(p->trapframe), PTE_R | PTE_W) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
+  // map the vDSO page below the trapframe, for user
+  // space to read but not write.
+  if(mappages(pagetable, VDSO, PGSIZE,
+              (uint64)(p->vdso), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
+  if((p->kpagetable = kvmcreate(pagetable)) == 0){
+    proc_freepagetable(pagetable, 0);
+    return 0;
+  }
+
+  return pagetable;
+}
+
+// Free a process's page table, and free the
+// physical memory it refers to.
+void
+proc_freepagetable(pagetable_t pagetable, uint64 sz)
+{
+  uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+  uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, VDSO, 1, 0);
+  uvmfree(pagetable, sz);
+}
+
+// Start a user process running the flat program image
+// code[0..sz), loaded at address 0 with one page of stack
+// above it, arg in a0 and the console on fds 0-2, as a child
+// of the calling kernel thread, which can collect its exit
+// status with wait().
+// Returns the pid, or -1 if out of processes or memory.
+int
+uspawn(char *name, uchar *code, uint sz, uint64 arg)
+{
+  struct proc *p;
+  uint64 top;
+
+  if((p = allocproc()) == 0)
+    return -1;
+
+  if((p->trapframe = (struct trapframe *)kalloc()) == 0 ||
+     (p->vdso = (struct vdso *)kalloc()) == 0 ||
+     (p->pagetable = proc_pagetable(p)) == 0 ||
+     (top = uvmload(p->pagetable, code, sz)) == 0 ||
+     (p->sz = uvmalloc(p->pagetable, top, top + PGSIZE, PTE_W)) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return -1;
+  }
+
+  // standard input, output and error.
+  if(fileconsole(p) < 0){
+    freeproc(p);
+    release(&p->lock);
+    return -1;
+  }
+
+  memset(p->trapframe, 0, sizeof(*p->trapframe));
+  vdso_init(p->vdso, p);
+  fpu_init(p);
+  p->trapframe->epc = 0;      // user program counter
+  p->trapframe->sp = p->sz;   // user stack pointer
+  p->trapframe->a0 = arg;
+  p->context.ra = (uint64)forkret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  int pid = p->pid;
+  release(&p->lock);
+
+  acquire(&wait_lock);
+  p->parent = myproc();
+  release(&wait_lock);
+
+  acquire(&p->lock);
+  p->state = RUNNABLE;
+  release(&p->lock);
+
+  return pid;
+}
+
+// Grow or shrink user memory by n bytes.
+// Return 0 on success, -1 on failure.
+int
+growproc(int n)
+{
+  uint64 sz, a;
+  pte_t *pte;
+  struct proc *p = myproc();
+
+  sz = p->sz;
+  if(n > 0){
+    // don't grow into an shm_map() mapping.
+    for(a = PGROUNDUP(sz); a < sz + n && a < USERTOP; a += PGSIZE)
+      if((pte = walk(p->pagetable, a, 0)) != 0 && (*pte & PTE_V))
+        return -1;
+    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0)
+      return -1;
+  } else if(n < 0){
+    sz = uvmdealloc(p->pagetable, sz, sz + n);
+  }
+  p->sz = sz;
+  return 0;
+}
+
+// Create a kernel thread that runs fn(arg) on its own kernel
+// stack, with no user page table. If cpu >= 0, the thread only
+// ever runs on that cpu. The thread exits when fn returns.
+// Returns the new thread, or 0 if the process table is full.
+struct proc*
+kthread_create(void (*fn)(void*), void *arg, char *name, int cpu)
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    return 0;
+
+  p->kfn = fn;
+  p->karg = arg;
+  p->affinity = cpu;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+
+  release(&p->lock);
+
+  return p;
 }
 
 // a user program that calls exec("/init")
@@ -73,17 +331,39 @@ scheduler(void)
 
     for(p = proc; p < &proc[NPROC]; p++) {
       acquire(&p->lock);
-      if(p->state == RUNNABLE) {
+      if(p->state == RUNNABLE &&
+         (p->affinity < 0 || p->affinity == cpuid())) {
         // Switch to chosen process.  It is the process's job
         // to release its lock and then reacquire it
         // before jumping back to us.
         p->state = RUNNING;
         c->proc = p;
+
+        // a user process runs in the kernel on a page table
+        // that also maps its memory; kernel threads don't.
+        if(p->vdso)
+          vdso_sethart(p);
+        if(p->kpagetable)
+          loadkpagetable(p);
+
         swtch(&c->context, &p->context);
 
+        // p may have given the CPU straight to another
+        // process (see sleep_handoff()); the one that
+        // came back is c->proc, holding its lock.
+        p = c->proc;
+
+        if(p->kpagetable)
+          kvminithart();
+
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
+
+        // nobody will wait() for an exited kernel thread; its
+        // stack is no longer in use, so free it here.
+        if(p->state == ZOMBIE && p->parent == 0)
+          freeproc(p);
       }
       release(&p->lock);
     }
@@ -112,9 +392,37 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  if(p->pagetable)
+    fpu_switchout(p);
+
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
+  handoff_done();
+}
+
+// run in the kernel on p's page table.
+static void
+loadkpagetable(struct proc *p)
+{
+  sfence_vma();
+  w_satp(MAKE_SATP(p->kpagetable));
+  sfence_vma();
+}
+
+// after a process resumes from swtch(): if it was switched
+// to directly by sleep_handoff(), release the lock of the
+// process that gave it the CPU, as scheduler() would have.
+static void
+handoff_done(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *prev;
+
+  if((prev = c->handoff) != 0){
+    c->handoff = 0;
+    release(&prev->lock);
+  }
 }
 
 // Give up the CPU for one scheduling round.
@@ -152,7 +460,11 @@ void
 proc_mapstacks(pagetable_t kpgtbl)
 {
   struct proc *p;
-  
+
+#ifdef GLOBALKVM
+  // procinit() allocates them instead.
+  return;
+#endif
   for(p = proc; p < &proc[NPROC]; p++) {
     char *pa = kalloc();
     if(pa == 0)
@@ -162,6 +474,120 @@ proc_mapstacks(pagetable_t kpgtbl)
   }
 }
 
+// A new process's very first scheduling by scheduler()
+// will swtch to kthread_start.
+static void
+kthread_start(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  if(p->kfn == 0)
+    panic("kthread_start");
+  p->kfn(p->karg);
+  exit(0);
+}
+
+// A user process's very first scheduling by scheduler()
+// will swtch to forkret.
+void
+forkret(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+
+  usertrapret();
+}
+
+// Exit the current process.  Does not return.
+// An exited process remains in the zombie state
+// until its parent calls wait().
+void
+exit(int status)
+{
+  struct proc *p = myproc();
+  int fd;
+
+  // Close all open files.
+  for(fd = 0; fd < NOFILE; fd++){
+    if(p->ofile[fd]){
+      fileclose(p->ofile[fd]);
+      p->ofile[fd] = 0;
+    }
+  }
+
+  // stop anything still using our memory.
+  if(p->pagetable){
+    ring_exit(p);
+    ipc_exit(p);
+  }
+
+  acquire(&wait_lock);
+
+  // Parent might be sleeping in wait().
+  if(p->parent)
+    wakeup(p->parent);
+
+  acquire(&p->lock);
+
+  p->xstate = status;
+  p->state = ZOMBIE;
+
+  release(&wait_lock);
+
+  // Jump into the scheduler, never to return.
+  sched();
+  panic("zombie exit");
+}
+
+// Wait for a child process to exit and return its pid.
+// Return -1 if this process has no children.
+// Unlike the system call, status is a kernel address.
+int
+wait(int *status)
+{
+  struct proc *pp;
+  int havekids, pid;
+  struct proc *p = myproc();
+
+  acquire(&wait_lock);
+
+  for(;;){
+    // Scan through table looking for exited children.
+    havekids = 0;
+    for(pp = proc; pp < &proc[NPROC]; pp++){
+      if(pp->parent == p){
+        // make sure the child isn't still in exit() or swtch().
+        acquire(&pp->lock);
+
+        havekids = 1;
+        if(pp->state == ZOMBIE){
+          // Found one.
+          pid = pp->pid;
+          if(status)
+            *status = pp->xstate;
+          freeproc(pp);
+          release(&pp->lock);
+          release(&wait_lock);
+          return pid;
+        }
+        release(&pp->lock);
+      }
+    }
+
+    // No point waiting if we don't have any children.
+    if(!havekids || p->killed){
+      release(&wait_lock);
+      return -1;
+    }
+
+    // Wait for a child to exit.
+    sleep(p, &wait_lock);  //DOC: wait-sleep
+  }
+}
+
 // Return the current struct proc *, or zero if none.
 struct proc*
 myproc(void)
@@ -191,6 +617,98 @@ wakeup(void *chan)
   }
 }
 
+// Wake up p if it is sleeping on chan.
+// Cheaper than wakeup() when the sleeper is known,
+// e.g. a worker thread woken from an interrupt.
+void
+wakeup_proc(struct proc *p, void *chan)
+{
+  if(p == myproc())
+    return;
+  acquire(&p->lock);
+  if(p->state == SLEEPING && p->chan == chan)
+    p->state = RUNNABLE;
+  release(&p->lock);
+}
+
+// Like sleep(), but give the CPU straight to process to,
+// which must be a user process sleeping on tochan, instead
+// of making it RUNNABLE and leaving it for scheduler().
+// Used by IPC, so that a message and its reply each cost a
+// single switch. Falls back to wakeup_proc() and sleep()
+// if to isn't asleep or can't run on this cpu.
+void
+sleep_handoff(void *chan, struct spinlock *lk, struct proc *to, void *tochan)
+{
+  struct proc *p = myproc();
+  struct cpu *c;
+  int intena;
+
+  acquire(&p->lock);
+  acquire(&to->lock);
+  if(to->state != SLEEPING || to->chan != tochan || to->kpagetable == 0 ||
+     (to->affinity >= 0 && to->affinity != cpuid())){
+    release(&to->lock);
+    release(&p->lock);
+    wakeup_proc(to, tochan);
+    sleep(chan, lk);
+    return;
+  }
+  release(lk);
+
+  // Go to sleep, as sched() would, and have to
+  // release our lock once it is running.
+  p->chan = chan;
+  p->state = SLEEPING;
+  to->state = RUNNING;
+  if(p->pagetable)
+    fpu_switchout(p);
+
+  c = mycpu();
+  c->proc = to;
+  c->handoff = p;
+  if(to->vdso)
+    vdso_sethart(to);
+  if(to->kpagetable != p->kpagetable)
+    loadkpagetable(to);
+
+  intena = c->intena;
+  swtch(&p->context, &to->context);
+  mycpu()->intena = intena;
+  handoff_done();
+
+  // Tidy up.
+  p->chan = 0;
+
+  // Reacquire original lock.
+  release(&p->lock);
+  acquire(lk);
+}
+
+// Kill the process with the given pid.
+// The victim won't exit until it tries to return
+// to user space (see usertrap() in trap.c).
+int
+kill(int pid)
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid){
+      p->killed = 1;
+      if(p->state == SLEEPING){
+        // Wake process from sleep().
+        p->state = RUNNABLE;
+      }
+      release(&p->lock);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
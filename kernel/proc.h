@@ -24,6 +24,10 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint softirq_pending;       // Bitmap of raised softirqs, see softirq.h.
+  int in_softirq;             // Running softirq handlers?
+  struct proc *fpowner;       // Whose FP state is in this hart's registers.
+  struct proc *handoff;       // Release its lock after swtch(); see sleep_handoff().
 };
 
 extern struct cpu cpus[NCPU];
@@ -79,8 +83,17 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// floating-point registers, saved only for processes
+// that use them; see fpu.c.
+struct fpstate {
+  /*   0 */ uint64 f[32];
+  /* 256 */ uint64 fcsr;
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+struct vdso;
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -91,6 +104,7 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int affinity;                // Only run on this cpu, or -1 for any
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
@@ -99,7 +113,23 @@ struct proc {
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
+  pagetable_t kpagetable;      // Kernel page table while serving this process
   struct trapframe *trapframe; // data page for trampoline.S
+  struct vdso *vdso;           // read-only data page for user space
   struct context context;      // swtch() here to run process
+  struct fpstate fp;           // FP registers, while not loaded
+  int fpcpu;                   // Hart that last loaded fp, or -1
+  struct file *ofile[NOFILE];  // Open files
   char name[16];               // Process name (debugging)
+
+  // ipc.c's ipc_lock must be held when using these:
+  int ipc_state;               // Where in a call or receive, see ipc.c
+  struct proc *ipc_next;       // Next caller queued on the same endpoint
+  struct proc *ipc_client;     // Caller awaiting our reply
+  struct proc *ipc_server;     // Server that took our message
+
+  // kernel threads have no pagetable or trapframe; they
+  // start in kthread_start() and run kfn(karg).
+  void (*kfn)(void*);
+  void *karg;
 };
@@ -0,0 +1,253 @@
+//
+// asynchronous system call rings; see ring.h.
+//
+// a process that sets up a ring can queue many calls and
+// submit them with one ring_enter(), or none at all if a
+// polling thread is consuming them, and collects results
+// without trapping.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "ring.h"
+#include "errno.h"
+#include "defs.h"
+
+// how long an idle polling thread keeps polling
+// before it goes to sleep, in time CSR units.
+#define RING_IDLE 10000  // about 1ms
+
+struct ring {
+  struct spinlock lock;
+  struct ring_shared *sh;  // the shared page, via the direct map
+  struct proc *owner;
+  struct proc *poller;     // polling kernel thread, if any
+  int stop;                // ask the poller to exit
+};
+
+// one per process slot.
+static struct ring rings[NPROC];
+
+extern struct proc proc[NPROC];
+
+static struct ring*
+ringof(struct proc *p)
+{
+  return &rings[p - proc];
+}
+
+void
+ringinit(void)
+{
+  struct ring *r;
+
+  for(r = rings; r < &rings[NPROC]; r++)
+    initlock(&r->lock, "ring");
+}
+
+// run one submission on behalf of r->owner.
+static uint64
+ring_op(struct ring *r, struct ring_sqe *sqe)
+{
+  char buf[128];
+  uint64 addr, n, len;
+
+  switch(sqe->opcode){
+  case RING_OP_NOP:
+    return 0;
+  case RING_OP_WRITE:
+    addr = sqe->addr;
+    len = sqe->len;
+    for(n = 0; n < len; n += sizeof(buf)){
+      int m = len - n < sizeof(buf) ? len - n : sizeof(buf);
+      if(copy_from_user(buf, addr + n, m) < 0)
+        return n ? n : -EFAULT;
+      uartwrite(buf, m);
+    }
+    return len;
+  }
+  return -EINVAL;
+}
+
+// consume up to max submissions, posting a completion for
+// each, while there is room in the completion queue.
+// called by the owner or by its poller, never both at once.
+// returns the number consumed.
+static int
+ring_submit(struct ring *r, int max)
+{
+  struct ring_shared *sh = r->sh;
+  struct ring_sqe sqe;
+  struct ring_cqe *cqe;
+  uint head, tail;
+  int n;
+
+  head = sh->sq_head;
+  tail = __atomic_load_n(&sh->sq_tail, __ATOMIC_ACQUIRE);
+  for(n = 0; n < max && head != tail; n++, head++){
+    if(sh->cq_tail - __atomic_load_n(&sh->cq_head, __ATOMIC_ACQUIRE) == RING_NCQ)
+      break;
+    // the process may change the entry under us;
+    // work from a copy.
+    sqe = sh->sq[head % RING_NSQ];
+    __atomic_store_n(&sh->sq_head, head + 1, __ATOMIC_RELEASE);
+
+    cqe = &sh->cq[sh->cq_tail % RING_NCQ];
+    cqe->user_data = sqe.user_data;
+    cqe->res = ring_op(r, &sqe);
+    __atomic_store_n(&sh->cq_tail, sh->cq_tail + 1, __ATOMIC_RELEASE);
+  }
+  return n;
+}
+
+static int
+ring_sq_empty(struct ring *r)
+{
+  return r->sh->sq_head == __atomic_load_n(&r->sh->sq_tail, __ATOMIC_ACQUIRE);
+}
+
+// the polling thread. it runs on its owner's page table,
+// so that copy_from_user() reaches the owner's memory.
+static void
+ring_poll(void *arg)
+{
+  struct ring *r = arg;
+  struct proc *p = myproc();
+  uint64 idle;
+
+  acquire(&p->lock);
+  p->kpagetable = r->owner->kpagetable;
+  w_satp(MAKE_SATP(p->kpagetable));
+  sfence_vma();
+  release(&p->lock);
+
+  idle = r_time();
+  while(!r->stop){
+    if(ring_submit(r, RING_NSQ) > 0){
+      idle = r_time();
+      continue;
+    }
+    if(r_time() - idle < RING_IDLE){
+      yield();
+      continue;
+    }
+
+    // nothing for a while: ask to be woken, then check
+    // once more, since the process may have queued an
+    // entry before it saw the flag.
+    acquire(&r->lock);
+    __atomic_or_fetch(&r->sh->flags, RING_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+    if(ring_sq_empty(r) && !r->stop)
+      sleep(r, &r->lock);
+    __atomic_and_fetch(&r->sh->flags, ~RING_SQ_NEED_WAKEUP, __ATOMIC_SEQ_CST);
+    release(&r->lock);
+    idle = r_time();
+  }
+
+  // leave the owner's page table before it can be freed.
+  acquire(&p->lock);
+  p->kpagetable = 0;
+  kvminithart();
+  release(&p->lock);
+
+  acquire(&r->lock);
+  r->poller = 0;
+  wakeup(&r->poller);
+  release(&r->lock);
+}
+
+// set up the calling process's ring, mapped at RING.
+// returns RING, or a negative error.
+uint64
+sys_ring_setup(void)
+{
+  struct proc *p = myproc();
+  struct ring *r = ringof(p);
+  char *mem;
+  int flags;
+
+  argint(0, &flags);
+  if(flags & ~RING_SETUP_SQPOLL)
+    return -EINVAL;
+  if(r->sh)
+    return -EBUSY;
+  if((mem = kalloc()) == 0)
+    return -ENOMEM;
+  memset(mem, 0, PGSIZE);
+  if(mappages(p->pagetable, RING, PGSIZE, (uint64)mem, PTE_R | PTE_W | PTE_U) < 0){
+    kfree(mem);
+    return -ENOMEM;
+  }
+  r->sh = (struct ring_shared *)mem;
+  r->owner = p;
+  r->stop = 0;
+
+  if(flags & RING_SETUP_SQPOLL){
+    r->poller = kthread_create(ring_poll, r, "ringpoll", -1);
+    if(r->poller == 0){
+      ring_free(p);
+      return -ENOMEM;
+    }
+  }
+  return RING;
+}
+
+// submit up to n queued entries. with RING_ENTER_SQ_WAKEUP,
+// just wake the polling thread instead.
+// returns the number submitted.
+uint64
+sys_ring_enter(void)
+{
+  struct ring *r = ringof(myproc());
+  int n, flags;
+
+  argint(0, &n);
+  argint(1, &flags);
+  if(r->sh == 0)
+    return -EINVAL;
+  if(r->poller){
+    if(flags & RING_ENTER_SQ_WAKEUP){
+      acquire(&r->lock);
+      wakeup(r);
+      release(&r->lock);
+    }
+    return 0;
+  }
+  if(n < 0)
+    return -EINVAL;
+  return ring_submit(r, n);
+}
+
+// stop p's polling thread, if it has one.
+// called by exit(), while p's memory is still there.
+void
+ring_exit(struct proc *p)
+{
+  struct ring *r = ringof(p);
+
+  acquire(&r->lock);
+  r->stop = 1;
+  wakeup(r);
+  while(r->poller)
+    sleep(&r->poller, &r->lock);
+  release(&r->lock);
+}
+
+// unmap and free p's ring, if it has one.
+void
+ring_free(struct proc *p)
+{
+  struct ring *r = ringof(p);
+
+  if(r->sh == 0)
+    return;
+  if(r->poller)
+    panic("ring_free");
+  uvmunmap(p->pagetable, RING, 1, 1);
+  r->sh = 0;
+  r->owner = 0;
+}
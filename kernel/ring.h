@@ -0,0 +1,56 @@
+//
+// asynchronous system call rings, shared between a process
+// and the kernel in one page mapped at RING.
+//
+// the process fills in submission queue entries and advances
+// sq_tail; the kernel consumes them, advancing sq_head, and
+// posts a completion queue entry for each, advancing cq_tail,
+// which the process consumes by advancing cq_head. indices
+// run freely and are reduced modulo the ring size.
+//
+// the kernel consumes submissions when the process calls
+// ring_enter(), or, with RING_SETUP_SQPOLL, from a kernel
+// thread that polls sq_tail. when that thread goes idle it
+// sets RING_SQ_NEED_WAKEUP in flags, and the process must
+// call ring_enter() with RING_ENTER_SQ_WAKEUP to restart it.
+//
+
+#define RING_NSQ 32   // submission queue entries
+#define RING_NCQ 64   // completion queue entries
+
+// ring_setup() flags.
+#define RING_SETUP_SQPOLL    0x1
+
+// ring_enter() flags.
+#define RING_ENTER_SQ_WAKEUP 0x1
+
+// flags the kernel sets for the process to see.
+#define RING_SQ_NEED_WAKEUP  0x1
+
+// operations.
+#define RING_OP_NOP    0   // complete with res 0
+#define RING_OP_WRITE  1   // write len bytes at addr to the console
+
+struct ring_sqe {
+  uint8 opcode;
+  uint8 pad[7];
+  uint64 addr;
+  uint64 len;
+  uint64 user_data;  // copied to the completion
+};
+
+struct ring_cqe {
+  uint64 user_data;
+  uint64 res;        // what the call returned, as in a0
+};
+
+struct ring_shared {
+  uint sq_head;
+  uint sq_tail;
+  uint cq_head;
+  uint cq_tail;
+  uint flags;
+  uint pad[3];
+  struct ring_sqe sq[RING_NSQ];
+  struct ring_cqe cq[RING_NCQ];
+};
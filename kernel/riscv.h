@@ -42,6 +42,11 @@ w_mepc(uint64 x)
 
 // Supervisor Status Register, sstatus
 
+#define SSTATUS_SUM (1L << 18) // Supervisor may access User memory
+#define SSTATUS_FS (3L << 13)  // FP state:
+#define SSTATUS_FS_OFF (0L << 13)   // FP instructions trap
+#define SSTATUS_FS_CLEAN (2L << 13) // registers unchanged since loaded
+#define SSTATUS_FS_DIRTY (3L << 13) // registers changed
 #define SSTATUS_SPP (1L << 8)  // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5) // Supervisor Previous Interrupt Enable
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
@@ -95,6 +100,39 @@ w_sie(uint64 x)
   asm volatile("csrw sie, %0" : : "r" (x));
 }
 
+// Supervisor-level AIA registers for the IMSIC, written by
+// CSR number since older assemblers don't know their names.
+
+// indirect access to this hart's IMSIC interrupt file:
+// pick a register with siselect, then use sireg.
+#define SISELECT_EIDELIVERY  0x70 // 1 = deliver interrupts to the hart
+#define SISELECT_EITHRESHOLD 0x72 // mask identities >= this; 0 masks none
+#define SISELECT_EIE0        0xc0 // enable bits for identities 0..63
+
+static inline void
+w_siselect(uint64 x)
+{
+  asm volatile("csrw 0x150, %0" : : "r" (x));
+}
+
+static inline void
+w_sireg(uint64 x)
+{
+  asm volatile("csrw 0x151, %0" : : "r" (x));
+}
+
+// Supervisor Top External Interrupt: the highest-priority
+// pending and enabled identity in this hart's interrupt file,
+// in bits 26:16. swapping in zero also claims it, clearing
+// its pending bit.
+static inline uint64
+stopei_claim()
+{
+  uint64 x;
+  asm volatile("csrrw %0, 0x15c, zero" : "=r" (x) );
+  return x;
+}
+
 // Machine-mode Interrupt Enable
 #define MIE_MEIE (1L << 11) // external
 #define MIE_MTIE (1L << 7)  // timer
@@ -256,6 +294,31 @@ r_mcounteren()
   return x;
 }
 
+// Supervisor-mode Counter-Enable: lets user mode
+// read the counters (bit 0 cycle, bit 1 time).
+static inline void 
+w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
+static inline uint64
+r_scounteren()
+{
+  uint64 x;
+  asm volatile("csrr %0, scounteren" : "=r" (x) );
+  return x;
+}
+
+// clock cycles, for fine-grained timing.
+static inline uint64
+r_cycle()
+{
+  uint64 x;
+  asm volatile("csrr %0, cycle" : "=r" (x) );
+  return x;
+}
+
 // machine-mode cycle counter
 static inline uint64
 r_time()
@@ -343,6 +406,9 @@ typedef uint64 *pagetable_t; // 512 PTEs
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // user can access
+#define PTE_G (1L << 5) // global: in every address space
+#define PTE_COW (1L << 8) // software: copy on write, see uvmcow()
+#define PTE_SHM (1L << 9) // software: a shm_map() page, shared by design
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
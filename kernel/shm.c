@@ -0,0 +1,305 @@
+//
+// shared memory objects.
+//
+// an object is a named set of physical pages that processes
+// map into their address spaces, so that a producer and a
+// consumer can pass data without copying it through the
+// kernel. each mapping holds a reference to every page (see
+// kref() in kalloc.c), as does the object itself. an object
+// lasts until shm_unlink() removes its name and the last
+// mapping goes, whichever is later; after the unlink, a
+// shm_create() of the name makes a new object.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "errno.h"
+#include "defs.h"
+
+#define NSHM       16   // objects in the system
+#define SHMMAXPG   64   // pages per object
+#define NSHMMAP     8   // mappings per process
+
+// shm_create() flags.
+#define SHM_CONTIG  0x1 // physically contiguous pages
+
+// shm_map() protections.
+#define SHM_READ    0x1
+#define SHM_WRITE   0x2
+#define SHM_EXEC    0x4
+
+struct shm {
+  char name[16];
+  int npages;           // 0 if the slot is free
+  int flags;            // as given to shm_create()
+  int linked;           // shm_create() of name finds it
+  int nmap;             // mappings, in all processes
+  uint64 pages[SHMMAXPG];
+};
+
+struct shmmap {
+  struct shm *shm;      // 0 if the slot is free
+  uint64 va;
+};
+
+static struct spinlock shm_lock;
+static struct shm shms[NSHM];
+
+// each process's mappings, by process slot.
+static struct shmmap shmmaps[NPROC][NSHMMAP];
+
+extern struct proc proc[NPROC];
+
+void
+shminit(void)
+{
+  initlock(&shm_lock, "shm");
+}
+
+static void
+shm_destroy(struct shm *s)
+{
+  for(int i = 0; i < s->npages; i++)
+    kfree((void*)s->pages[i]);
+  s->name[0] = 0;
+  s->npages = 0;
+  s->linked = 0;
+}
+
+// find the object called name, or make one of sz bytes.
+// an existing one must be at least sz bytes, and contiguous
+// if asked for. returns its id, or a negative error.
+static int
+shm_create(char *name, uint64 sz, int flags)
+{
+  struct shm *s, *free = 0;
+  int i, n;
+  char *pa;
+
+  n = PGROUNDUP(sz) / PGSIZE;
+  if(name[0] == 0 || n <= 0 || n > SHMMAXPG || (flags & ~SHM_CONTIG))
+    return -EINVAL;
+
+  acquire(&shm_lock);
+  for(s = shms; s < &shms[NSHM]; s++){
+    if(s->npages == 0){
+      if(free == 0)
+        free = s;
+    } else if(s->linked && strncmp(s->name, name, sizeof(s->name)) == 0){
+      i = s - shms;
+      if(n > s->npages || (flags & ~s->flags))
+        i = -EINVAL;
+      release(&shm_lock);
+      return i;
+    }
+  }
+  if((s = free) == 0){
+    release(&shm_lock);
+    return -ENOMEM;
+  }
+
+  if(flags & SHM_CONTIG){
+    if((pa = kalloc_contig(n)) == 0){
+      release(&shm_lock);
+      return -ENOMEM;
+    }
+    for(i = 0; i < n; i++)
+      s->pages[i] = (uint64)pa + i*PGSIZE;
+  } else {
+    for(i = 0; i < n; i++){
+      if((pa = kalloc()) == 0){
+        s->npages = i;
+        shm_destroy(s);
+        release(&shm_lock);
+        return -ENOMEM;
+      }
+      s->pages[i] = (uint64)pa;
+    }
+  }
+  for(i = 0; i < n; i++)
+    memset((void*)s->pages[i], 0, PGSIZE);
+  s->npages = n;
+  s->flags = flags;
+  s->linked = 1;
+  s->nmap = 0;
+  safestrcpy(s->name, name, sizeof(s->name));
+  release(&shm_lock);
+  return s - shms;
+}
+
+// map object id at va in p's address space.
+static int
+shm_map(struct proc *p, int id, uint64 va, int prot)
+{
+  struct shmmap *m, *free = 0;
+  struct shm *s;
+  uint64 a;
+  int i, perm;
+
+  if(id < 0 || id >= NSHM || va % PGSIZE != 0 ||
+     (prot & ~(SHM_READ|SHM_WRITE|SHM_EXEC)) || prot == 0)
+    return -EINVAL;
+  perm = PTE_U | PTE_SHM;
+  if(prot & SHM_READ)
+    perm |= PTE_R;
+  if(prot & SHM_WRITE)
+    perm |= PTE_R | PTE_W;
+  if(prot & SHM_EXEC)
+    perm |= PTE_X;
+
+  acquire(&shm_lock);
+  s = &shms[id];
+  if(s->npages == 0 || va >= USERTOP || s->npages*PGSIZE > USERTOP - va)
+    goto bad;
+  for(m = shmmaps[p - proc]; m < &shmmaps[p - proc][NSHMMAP]; m++)
+    if(m->shm == 0 && free == 0)
+      free = m;
+  if(free == 0)
+    goto bad;
+  // don't map over anything.
+  for(a = va; a < va + s->npages*PGSIZE; a += PGSIZE){
+    pte_t *pte = walk(p->pagetable, a, 0);
+    if(pte && (*pte & PTE_V))
+      goto bad;
+  }
+  for(i = 0; i < s->npages; i++){
+    if(mappages(p->pagetable, va + i*PGSIZE, PGSIZE, s->pages[i], perm) < 0){
+      uvmunmap(p->pagetable, va, i, 1);
+      release(&shm_lock);
+      return -ENOMEM;
+    }
+    kref((void*)s->pages[i]);
+  }
+  s->nmap++;
+  free->shm = s;
+  free->va = va;
+  release(&shm_lock);
+  return 0;
+
+bad:
+  release(&shm_lock);
+  return -EINVAL;
+}
+
+// undo mapping m of p's. caller holds shm_lock.
+static void
+shm_unmap1(struct proc *p, struct shmmap *m)
+{
+  struct shm *s = m->shm;
+
+  uvmunmap(p->pagetable, m->va, s->npages, 1);
+  m->shm = 0;
+  if(--s->nmap == 0 && !s->linked)
+    shm_destroy(s);
+}
+
+// remove the name of the object called name. it's
+// destroyed now if nobody has it mapped, or else
+// when the last mapping goes.
+static int
+shm_unlink(char *name)
+{
+  struct shm *s;
+
+  acquire(&shm_lock);
+  for(s = shms; s < &shms[NSHM]; s++){
+    if(s->npages && s->linked && strncmp(s->name, name, sizeof(s->name)) == 0){
+      s->linked = 0;
+      if(s->nmap == 0)
+        shm_destroy(s);
+      release(&shm_lock);
+      return 0;
+    }
+  }
+  release(&shm_lock);
+  return -ENOENT;
+}
+
+static int
+shm_unmap(struct proc *p, uint64 va)
+{
+  struct shmmap *m;
+
+  acquire(&shm_lock);
+  for(m = shmmaps[p - proc]; m < &shmmaps[p - proc][NSHMMAP]; m++){
+    if(m->shm && m->va == va){
+      shm_unmap1(p, m);
+      release(&shm_lock);
+      // the TLB may still hold the mappings.
+      sfence_vma();
+      return 0;
+    }
+  }
+  release(&shm_lock);
+  return -EINVAL;
+}
+
+// undo all of p's mappings, before its page table is freed.
+void
+shm_free(struct proc *p)
+{
+  struct shmmap *m;
+
+  acquire(&shm_lock);
+  for(m = shmmaps[p - proc]; m < &shmmaps[p - proc][NSHMMAP]; m++)
+    if(m->shm)
+      shm_unmap1(p, m);
+  release(&shm_lock);
+}
+
+uint64
+sys_shm_create(void)
+{
+  char name[16];
+  uint64 uname, sz;
+  int flags, n;
+
+  argaddr(0, &uname);
+  argaddr(1, &sz);
+  argint(2, &flags);
+  if((n = strncpy_from_user(name, uname, sizeof(name))) < 0)
+    return n;
+  if(n == sizeof(name))
+    return -EINVAL;
+  return shm_create(name, sz, flags);
+}
+
+uint64
+sys_shm_map(void)
+{
+  uint64 va;
+  int id, prot;
+
+  argint(0, &id);
+  argaddr(1, &va);
+  argint(2, &prot);
+  return shm_map(myproc(), id, va, prot);
+}
+
+uint64
+sys_shm_unmap(void)
+{
+  uint64 va;
+
+  argaddr(0, &va);
+  return shm_unmap(myproc(), va);
+}
+
+uint64
+sys_shm_unlink(void)
+{
+  char name[16];
+  uint64 uname;
+  int n;
+
+  argaddr(0, &uname);
+  if((n = strncpy_from_user(name, uname, sizeof(name))) < 0)
+    return n;
+  if(n == sizeof(name))
+    return -EINVAL;
+  return shm_unlink(name);
+}
@@ -0,0 +1,162 @@
+//
+// softirqs: the bottom half of interrupt handling.
+//
+// a device's top half runs in devintr() with interrupts off;
+// it acknowledges the device, takes whatever cannot wait,
+// and raise_softirq()s the rest. devintr() then completes
+// the PLIC claim at once, and on the way out of the trap
+// do_softirq() runs the raised handlers with interrupts
+// enabled, so other devices are not held off by the slow part.
+//
+// each hart has its own pending bitmap in struct cpu. if the
+// handlers are still busy when the time budget runs out, the
+// remainder is handed to the hart's worker thread. a pass
+// there is no more preemptible than one on the way out of a
+// trap, but it ends with the same budget, and the worker can
+// be preempted between passes, so the remainder shares the
+// hart with other threads instead of holding them off.
+//
+// softirq handlers must not sleep.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "softirq.h"
+#include "workqueue.h"
+#include "defs.h"
+
+// time budget for one pass, in cycles (about 2ms in qemu).
+#define SOFTIRQ_BUDGET 20000
+
+static void (*softirq_vec[NSOFTIRQ])(void);
+
+// per-hart work item that continues an over-budget pass.
+static struct work softirq_work[NCPU];
+
+// statistics, printed by softirqdump().
+static uint64 softirq_count[NCPU][NSOFTIRQ];
+static uint64 softirq_deferred[NCPU];
+
+static void softirqwork(struct work*);
+
+void
+softirqinit(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initwork(&softirq_work[i], softirqwork);
+}
+
+// install fn as the handler for softirq nr.
+void
+open_softirq(int nr, void (*fn)(void))
+{
+  if(nr < 0 || nr >= NSOFTIRQ)
+    panic("open_softirq");
+  softirq_vec[nr] = fn;
+}
+
+// mark softirq nr pending on this hart.
+// called by top halves.
+void
+raise_softirq(int nr)
+{
+  push_off();
+  mycpu()->softirq_pending |= 1 << nr;
+  pop_off();
+}
+
+// run pending handlers until none are left or the budget
+// is spent. called with interrupts off and no locks held;
+// returns with interrupts off. returns 1 if softirqs are
+// still pending.
+static int
+__do_softirq(void)
+{
+  struct cpu *c = mycpu();
+  int id = cpuid();
+  uint64 start = r_time();
+  uint pending;
+  int nr;
+
+  // a trap taken while the handlers run must neither
+  // recurse into them nor yield (see kerneltrap()), so
+  // c stays this hart's cpu throughout.
+  c->in_softirq = 1;
+  while((pending = c->softirq_pending) != 0){
+    c->softirq_pending = 0;
+    intr_on();
+    for(nr = 0; nr < NSOFTIRQ; nr++){
+      if((pending & (1 << nr)) && softirq_vec[nr]){
+        softirq_vec[nr]();
+        softirq_count[id][nr]++;
+      }
+    }
+    intr_off();
+    if(r_time() - start >= SOFTIRQ_BUDGET)
+      break;
+  }
+  c->in_softirq = 0;
+
+  return c->softirq_pending != 0;
+}
+
+// called on the way out of a device interrupt,
+// with interrupts off.
+void
+do_softirq(void)
+{
+  struct cpu *c = mycpu();
+
+  if(c->in_softirq || c->softirq_pending == 0)
+    return;
+
+  if(__do_softirq()){
+    // out of budget: let this hart's worker thread finish.
+    softirq_deferred[cpuid()]++;
+    queue_work(&softirq_work[cpuid()]);
+  }
+}
+
+// runs in the hart's worker thread, interrupts on.
+static void
+softirqwork(struct work *w)
+{
+  // __do_softirq() wants interrupts off, but push_off()
+  // would stop the handlers from turning them back on.
+  intr_off();
+  if(__do_softirq())
+    queue_work(w);  // go round again behind other work.
+  intr_on();
+}
+
+static char *softirq_names[] = {
+[SOFTIRQ_TIMER] "timer",
+[SOFTIRQ_UART]  "uart",
+[SOFTIRQ_DISK]  "disk",
+};
+
+// print per-hart softirq counts. called by intrdump().
+void
+softirqdump(void)
+{
+  uint64 n;
+  int i, nr;
+
+  for(i = 0; i < NCPU; i++){
+    n = softirq_deferred[i];
+    for(nr = 0; nr < NSOFTIRQ; nr++)
+      n += softirq_count[i][nr];
+    if(n == 0)
+      continue;
+    printf("hart %d softirq:", i);
+    for(nr = 0; nr < NSOFTIRQ; nr++)
+      printf(" %s %d", softirq_names[nr], (int)softirq_count[i][nr]);
+    printf(" deferred %d\n", (int)softirq_deferred[i]);
+  }
+}
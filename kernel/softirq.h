@@ -0,0 +1,5 @@
+// Softirq numbers. Lower numbers run first.
+#define SOFTIRQ_TIMER  0  // tick sleepers and futex timeouts
+#define SOFTIRQ_UART   1  // console input and uart output
+#define SOFTIRQ_DISK   2  // disk completions
+#define NSOFTIRQ       3
@@ -13,6 +13,9 @@ __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 // a scratch area per CPU for machine-mode timer interrupts.
 uint64 timer_scratch[NCPU][5];
 
+// mtime when hart 0's ticks began.
+uint64 timer_base;
+
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
 
@@ -43,6 +46,11 @@ start()
   w_pmpaddr0(0x3fffffffffffffull);
   w_pmpcfg0(0xf);
 
+  // allow supervisor mode to read the cycle and time CSRs,
+  // and user mode too, so benchmarks can time themselves.
+  w_mcounteren(r_mcounteren() | 3);
+  w_scounteren(r_scounteren() | 3);
+
   // ask for clock interrupts.
   timerinit();
 
@@ -66,8 +74,14 @@ timerinit()
   int id = r_mhartid();
 
   // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
-  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
+  int interval = TIMER_INTERVAL;
+  uint64 now = *(uint64*)CLINT_MTIME;
+  *(uint64*)CLINT_MTIMECMP(id) = now + interval;
+
+  // hart 0's timer drives ticks; remember when it started
+  // so the vDSO can work out ticks from the time CSR.
+  if(id == 0)
+    timer_base = now;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..2] : space for timervec to save registers.
@@ -0,0 +1,207 @@
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "syscall.h"
+#include "defs.h"
+
+// the argument registers a0..a5 sit next to each other in
+// the trapframe, so fetch the nth one by index rather than
+// through a switch.
+static uint64
+argraw(int n)
+{
+  if(n < 0 || n > 5)
+    panic("argraw");
+  return (&myproc()->trapframe->a0)[n];
+}
+
+// Fetch the nth 32-bit system call argument.
+void
+argint(int n, int *ip)
+{
+  *ip = argraw(n);
+}
+
+// Retrieve an argument as a pointer.
+// Doesn't check for legality, since
+// copyin/copyout will do that.
+void
+argaddr(int n, uint64 *ip)
+{
+  *ip = argraw(n);
+}
+
+// Prototypes for the functions that handle system calls.
+extern uint64 sys_pipe(void);
+extern uint64 sys_read(void);
+extern uint64 sys_dup(void);
+extern uint64 sys_fstat(void);
+extern uint64 sys_open(void);
+extern uint64 sys_mknod(void);
+extern uint64 sys_unlink(void);
+extern uint64 sys_link(void);
+extern uint64 sys_mkdir(void);
+extern uint64 sys_sbrk(void);
+extern uint64 sys_write(void);
+extern uint64 sys_close(void);
+extern uint64 sys_exit(void);
+extern uint64 sys_getpid(void);
+extern uint64 sys_uptime(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_null(void);
+extern uint64 sys_ring_setup(void);
+extern uint64 sys_ring_enter(void);
+extern uint64 sys_yield(void);
+extern uint64 sys_ipc_call(void);
+extern uint64 sys_ipc_reply(void);
+extern uint64 sys_ipc_reply_wait(void);
+extern uint64 sys_shm_create(void);
+extern uint64 sys_shm_map(void);
+extern uint64 sys_shm_unmap(void);
+extern uint64 sys_vmsplice(void);
+extern uint64 sys_epoll_create(void);
+extern uint64 sys_epoll_ctl(void);
+extern uint64 sys_epoll_wait(void);
+extern uint64 sys_timerfd(void);
+extern uint64 sys_ipc_open(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_shm_unlink(void);
+
+// log2 buckets of the cycles spent in a system call;
+// the last bucket holds everything longer.
+#define NSYSHIST 16
+
+struct syscall {
+  char *name;
+  uint64 (*fn)(void);
+#ifdef SYSCALL_HOOKS
+  void (*enter)(int num);
+  void (*exit)(int num, uint64 ret);
+  uint64 count;
+  uint64 hist[NSYSHIST];
+#endif
+};
+
+// A table mapping syscall numbers from syscall.h
+// to the function that handles the system call.
+static struct syscall syscalls[] = {
+[SYS_exit]       { "exit",       sys_exit },
+[SYS_pipe]       { "pipe",       sys_pipe },
+[SYS_read]       { "read",       sys_read },
+[SYS_fstat]      { "fstat",      sys_fstat },
+[SYS_dup]        { "dup",        sys_dup },
+[SYS_getpid]     { "getpid",     sys_getpid },
+[SYS_sbrk]       { "sbrk",       sys_sbrk },
+[SYS_uptime]     { "uptime",     sys_uptime },
+[SYS_open]       { "open",       sys_open },
+[SYS_write]      { "write",      sys_write },
+[SYS_mknod]      { "mknod",      sys_mknod },
+[SYS_unlink]     { "unlink",     sys_unlink },
+[SYS_link]       { "link",       sys_link },
+[SYS_mkdir]      { "mkdir",      sys_mkdir },
+[SYS_close]      { "close",      sys_close },
+[SYS_futex_wait] { "futex_wait", sys_futex_wait },
+[SYS_futex_wake] { "futex_wake", sys_futex_wake },
+[SYS_null]       { "null",       sys_null },
+[SYS_ring_setup] { "ring_setup", sys_ring_setup },
+[SYS_ring_enter] { "ring_enter", sys_ring_enter },
+[SYS_yield]      { "yield",      sys_yield },
+[SYS_ipc_call]   { "ipc_call",   sys_ipc_call },
+[SYS_ipc_reply]  { "ipc_reply",  sys_ipc_reply },
+[SYS_ipc_reply_wait] { "ipc_reply_wait", sys_ipc_reply_wait },
+[SYS_shm_create] { "shm_create", sys_shm_create },
+[SYS_shm_map]    { "shm_map",    sys_shm_map },
+[SYS_shm_unmap]  { "shm_unmap",  sys_shm_unmap },
+[SYS_vmsplice]   { "vmsplice",   sys_vmsplice },
+[SYS_epoll_create] { "epoll_create", sys_epoll_create },
+[SYS_epoll_ctl]  { "epoll_ctl",  sys_epoll_ctl },
+[SYS_epoll_wait] { "epoll_wait", sys_epoll_wait },
+[SYS_timerfd]    { "timerfd",    sys_timerfd },
+[SYS_ipc_open]   { "ipc_open",   sys_ipc_open },
+[SYS_fsync]      { "fsync",      sys_fsync },
+[SYS_shm_unlink] { "shm_unlink", sys_shm_unlink },
+};
+
+#ifdef SYSCALL_HOOKS
+// install hooks to run before and after system call num.
+// either may be 0. returns -1 if there is no such call.
+int
+syscall_sethook(int num, void (*enter)(int), void (*exit)(int, uint64))
+{
+  if(num <= 0 || num >= NELEM(syscalls) || syscalls[num].fn == 0)
+    return -1;
+  syscalls[num].enter = enter;
+  syscalls[num].exit = exit;
+  return 0;
+}
+
+static int
+sysbucket(uint64 cycles)
+{
+  int b;
+
+  for(b = 0; cycles > 1 && b < NSYSHIST-1; b++)
+    cycles >>= 1;
+  return b;
+}
+#endif
+
+void
+syscall(void)
+{
+  int num;
+  struct proc *p = myproc();
+  struct syscall *s;
+
+  num = p->trapframe->a7;
+  if(num > 0 && num < NELEM(syscalls) && syscalls[num].fn) {
+    s = &syscalls[num];
+#ifdef SYSCALL_HOOKS
+    uint64 start = r_cycle();
+    if(s->enter)
+      s->enter(num);
+#endif
+    // Use num to lookup the system call function for num, call it,
+    // and store its return value in p->trapframe->a0
+    p->trapframe->a0 = s->fn();
+#ifdef SYSCALL_HOOKS
+    if(s->exit)
+      s->exit(num, p->trapframe->a0);
+    // several harts may be in the same call at once.
+    __sync_fetch_and_add(&s->count, 1);
+    __sync_fetch_and_add(&s->hist[sysbucket(r_cycle() - start)], 1);
+#endif
+  } else {
+    printf("%d %s: unknown sys call %d\n",
+            p->pid, p->name, num);
+    p->trapframe->a0 = -1;
+  }
+}
+
+// print per-syscall call counts and cycle histograms.
+// called on ^Y.
+void
+syscalldump(void)
+{
+#ifdef SYSCALL_HOOKS
+  struct syscall *s;
+  int b;
+
+  printf("\nsyscall          calls  cycles (log2 buckets)\n");
+  for(s = syscalls; s < &syscalls[NELEM(syscalls)]; s++){
+    if(s->fn == 0 || s->count == 0)
+      continue;
+    printf("%s\t\t%d ", s->name, (int)s->count);
+    for(b = 0; b < NSYSHIST; b++)
+      if(s->hist[b])
+        printf(" %d:%d", 1 << b, (int)s->hist[b]);
+    printf("\n");
+  }
+#else
+  printf("\nsyscall statistics not compiled in (make SYSCALL_HOOKS=1)\n");
+#endif
+}
@@ -20,3 +20,23 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_futex_wait 22
+#define SYS_futex_wake 23
+#define SYS_null   24
+#define SYS_ring_setup 25
+#define SYS_ring_enter 26
+#define SYS_yield  27
+#define SYS_ipc_call 28
+#define SYS_ipc_reply 29
+#define SYS_ipc_reply_wait 30
+#define SYS_shm_create 31
+#define SYS_shm_map 32
+#define SYS_shm_unmap 33
+#define SYS_vmsplice 34
+#define SYS_epoll_create 35
+#define SYS_epoll_ctl 36
+#define SYS_epoll_wait 37
+#define SYS_timerfd 38
+#define SYS_ipc_open 39
+#define SYS_fsync  40
+#define SYS_shm_unlink 41
@@ -0,0 +1,236 @@
+//
+// kernel timers, and timer file descriptors built on them.
+//
+// armed timers are kept sorted by deadline, so each tick
+// looks only at the timers that are due rather than at all
+// of them. a timer fd counts its expirations and is readable
+// while the count is non-zero; it can be waited on with
+// read() or through an eventpoll.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
+#include "timer.h"
+#include "errno.h"
+#include "defs.h"
+
+#define NTIMERFD 16
+
+struct timerfd {
+  struct timer timer;
+  uint64 expirations;        // since the last read()
+  struct pollhead poll;
+  int used;
+};
+
+// protects the armed list, and every timer fd.
+static struct spinlock timer_lock;
+static struct timer *timers;
+
+static struct timerfd timerfds[NTIMERFD];
+
+void
+timerinit(void)
+{
+  initlock(&timer_lock, "timer");
+}
+
+// caller holds timer_lock.
+static void
+timer_insert(struct timer *t)
+{
+  struct timer **pp;
+
+  for(pp = &timers; *pp; pp = &(*pp)->next)
+    if((int)(t->deadline - (*pp)->deadline) < 0)
+      break;
+  t->next = *pp;
+  *pp = t;
+  t->armed = 1;
+}
+
+// caller holds timer_lock.
+static void
+timer_unlink(struct timer *t)
+{
+  struct timer **pp;
+
+  for(pp = &timers; *pp; pp = &(*pp)->next){
+    if(*pp == t){
+      *pp = t->next;
+      break;
+    }
+  }
+  t->armed = 0;
+}
+
+// arm t to fire delay ticks from now, or re-arm it
+// if it is already armed.
+void
+add_timer(struct timer *t, uint delay)
+{
+  acquire(&timer_lock);
+  if(t->armed)
+    timer_unlink(t);
+  t->deadline = ticks + (delay ? delay : 1);
+  timer_insert(t);
+  release(&timer_lock);
+}
+
+void
+del_timer(struct timer *t)
+{
+  acquire(&timer_lock);
+  if(t->armed)
+    timer_unlink(t);
+  release(&timer_lock);
+}
+
+// called from the timer softirq: run the timers that are due.
+void
+timer_tick(void)
+{
+  struct timer *t;
+
+  if(timers == 0)
+    return;
+
+  acquire(&timer_lock);
+  while((t = timers) != 0 && (int)(ticks - t->deadline) >= 0){
+    timers = t->next;
+    t->armed = 0;
+    if(t->interval){
+      t->deadline += t->interval;
+      timer_insert(t);
+    }
+    t->fn(t);
+  }
+  release(&timer_lock);
+}
+
+static void
+timerfd_fire(struct timer *t)
+{
+  struct timerfd *tf = t->arg;
+
+  tf->expirations++;
+  wakeup(tf);
+  pollwake(&tf->poll, EPOLLIN);
+}
+
+// a timer fd that expires every interval ticks.
+int
+timerfd_alloc(struct file **fp, uint interval)
+{
+  struct timerfd *tf;
+  struct file *f;
+
+  if((f = filealloc()) == 0)
+    return -1;
+  acquire(&timer_lock);
+  for(tf = timerfds; tf < &timerfds[NTIMERFD]; tf++)
+    if(!tf->used)
+      goto found;
+  release(&timer_lock);
+  fileclose(f);
+  return -1;
+
+found:
+  tf->used = 1;
+  tf->expirations = 0;
+  tf->poll.items = 0;
+  tf->timer.fn = timerfd_fire;
+  tf->timer.arg = tf;
+  tf->timer.interval = interval;
+  release(&timer_lock);
+
+  f->type = FD_TIMER;
+  f->readable = 1;
+  f->writable = 0;
+  f->timer = tf;
+  add_timer(&tf->timer, interval);
+  *fp = f;
+  return 0;
+}
+
+void
+timerfd_close(struct timerfd *tf)
+{
+  acquire(&timer_lock);
+  if(tf->timer.armed)
+    timer_unlink(&tf->timer);
+  tf->used = 0;
+  release(&timer_lock);
+}
+
+// wait for the timer to expire, and copy the number of
+// expirations since the last read, a uint64, to addr.
+int
+timerfd_read(struct timerfd *tf, uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  uint64 x;
+
+  if(n < (int)sizeof(x))
+    return -EINVAL;
+  acquire(&timer_lock);
+  while(tf->expirations == 0){
+    if(p->killed){
+      release(&timer_lock);
+      return -EINTR;
+    }
+    sleep(tf, &timer_lock);
+  }
+  x = tf->expirations;
+  tf->expirations = 0;
+  release(&timer_lock);
+
+  if(copy_to_user(addr, &x, sizeof(x)) < 0)
+    return -EFAULT;
+  return sizeof(x);
+}
+
+int
+timerfd_poll(struct timerfd *tf)
+{
+  int events;
+
+  acquire(&timer_lock);
+  events = tf->expirations ? EPOLLIN : 0;
+  release(&timer_lock);
+  return events;
+}
+
+struct pollhead*
+timerfd_pollhead(struct timerfd *tf)
+{
+  return &tf->poll;
+}
+
+// timerfd(interval): a file that becomes readable every
+// interval ticks; read() it for the count of expirations.
+uint64
+sys_timerfd(void)
+{
+  struct file *f;
+  int interval, fd;
+
+  argint(0, &interval);
+  if(interval <= 0)
+    return -EINVAL;
+  if(timerfd_alloc(&f, interval) < 0)
+    return -ENOMEM;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
@@ -0,0 +1,12 @@
+// A kernel timer: fn(t) runs from the timer softirq once
+// ticks reaches t->deadline, with timer_lock held, so it
+// must not sleep or call add_timer() or del_timer().
+// a timer with an interval is re-armed before fn runs.
+struct timer {
+  uint deadline;             // ticks at which to fire
+  uint interval;             // if non-zero, fire again this often
+  void (*fn)(struct timer*);
+  void *arg;                 // for fn
+  struct timer *next;        // armed timers, soonest first
+  int armed;
+};
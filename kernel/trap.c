@@ -4,11 +4,15 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "softirq.h"
+#include "intc.h"
 #include "defs.h"
 
 struct spinlock tickslock;
 uint ticks;
 
+static void timersoftirq(void);
+
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
@@ -20,6 +24,7 @@ void
 trapinit(void)
 {
   initlock(&tickslock, "time");
+  open_softirq(SOFTIRQ_TIMER, timersoftirq);
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -53,6 +58,8 @@ usertrap(void)
   if(r_scause() == 8){
     // system call
 
+    if(p->killed)
+      exit(-1);
 
     // sepc points to the ecall instruction,
     // but we want to return to the next instruction.
@@ -62,13 +69,22 @@ usertrap(void)
     // so enable only now that we're done with those registers.
     intr_on();
 
+    syscall();
   } else if((which_dev = devintr()) != 0){
-    // ok
+    // run bottom halves, with interrupts enabled.
+    do_softirq();
+  } else if(r_scause() == 2 && fpu_trap(p)){
+    // first FP instruction since switch-in; retry it.
+  } else if(r_scause() == 15 && uvmcow(p->pagetable, PGROUNDDOWN(r_stval())) == 0){
+    // store to a copy-on-write page; retry it.
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
+    p->killed = 1;
   }
 
+  if(p->killed)
+    exit(-1);
 
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2)
@@ -138,20 +154,50 @@ kerneltrap()
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
+  // copy_to_user() storing to a copy-on-write page.
+  if(scause == 15 && (sstatus & SSTATUS_SUM) && myproc() &&
+     myproc()->pagetable &&
+     uvmcow(myproc()->pagetable, PGROUNDDOWN(r_stval())) == 0)
+    return;
+
+  // a bad user pointer in copy_from_user() or friends:
+  // resume at the fixup, which makes them fail.
+  if(scause == 5 || scause == 7 || scause == 13 || scause == 15){
+    uint64 fixup = uaccess_fixup(sepc);
+    if(fixup){
+      w_sepc(fixup);
+      return;
+    }
+  }
+
+  // the interrupted code may have been copying user memory;
+  // don't leave handlers, or whatever yield() switches to,
+  // able to touch it. sstatus is restored below.
+  if(sstatus & SSTATUS_SUM)
+    w_sstatus(sstatus & ~SSTATUS_SUM);
+
   if((which_dev = devintr()) == 0){
     printf("scause %p\n", scause);
     printf("sepc=%p stval=%p\n", r_sepc(), r_stval());
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  // run bottom halves, with interrupts enabled.
+  do_softirq();
+
+  // give up the CPU if this is a timer interrupt,
+  // unless it interrupted a softirq handler, which
+  // must finish on this hart.
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING &&
+     !mycpu()->in_softirq)
     yield();
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
+  // but keep FS as sched() left it, since the FP registers
+  // may no longer hold what they did.
   w_sepc(sepc);
-  w_sstatus(sstatus);
+  w_sstatus((sstatus & ~SSTATUS_FS) | (r_sstatus() & SSTATUS_FS));
 }
 
 void
@@ -159,8 +205,23 @@ clockintr()
 {
   acquire(&tickslock);
   ticks++;
+  release(&tickslock);
+
+  // wakeup() scans the whole process table; do that in
+  // the bottom half rather than here with interrupts off.
+  raise_softirq(SOFTIRQ_TIMER);
+}
+
+static void
+timersoftirq(void)
+{
+  acquire(&tickslock);
   wakeup(&ticks);
   release(&tickslock);
+
+  futex_tick();
+  timer_tick();
+  irqbalance();
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -175,24 +236,33 @@ devintr()
 
   if((scause & 0x8000000000000000L) &&
      (scause & 0xff) == 9){
-    // this is a supervisor external interrupt, via PLIC.
+    // this is a supervisor external interrupt, via the
+    // PLIC or this hart's IMSIC.
+
+    uint64 start = r_time();
 
     // irq indicates which device interrupted.
-    int irq = plic_claim();
+    int irq = intc->claim();
 
+    // top halves: acknowledge the device, take what can't
+    // wait, and raise a softirq for the rest.
     if(irq == UART0_IRQ){
       uartintr();
     } else if(irq == VIRTIO0_IRQ){
-      //virtio_disk_intr();
+      virtio_disk_intr();
+    } else if(irq >= NIRQ){
+      msiintr(irq);
     } else if(irq){
       printf("unexpected interrupt irq=%d\n", irq);
     }
 
     // the PLIC allows each device to raise at most one
-    // interrupt at a time; tell the PLIC the device is
-    // now allowed to interrupt again.
+    // interrupt at a time; tell the controller the device
+    // is now allowed to interrupt again, without waiting
+    // for the bottom half.
     if(irq)
-      plic_complete(irq);
+      intc->complete(irq);
+    irqstat(irq, r_time() - start);
 
     return 1;
   } else if(scause == 0x8000000000000001L){
@@ -0,0 +1,112 @@
+//
+// copying to and from user memory.
+//
+// the kernel serves a process on a page table that also maps
+// the process's memory (see kvmcreate()), so rather than walk
+// the user page table in software, these set sstatus.SUM and
+// let the MMU translate. a fault on a bad user address is
+// turned into -EFAULT through the exception table that
+// usercopy.S builds, instead of a kernel panic.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "errno.h"
+#include "defs.h"
+
+// usercopy.S
+int __copy_user(void *dst, void *src, uint64 n);
+int __strncpy_user(char *dst, char *src, int max);
+
+struct exception_table_entry {
+  uint64 insn;   // an instruction that may fault
+  uint64 fixup;  // where to resume if it does
+};
+
+// kernel.ld collects the entries.
+extern struct exception_table_entry __start___ex_table[];
+extern struct exception_table_entry __stop___ex_table[];
+
+// called by kerneltrap() on a page or access fault.
+// returns where to resume, or 0 if the faulting
+// instruction at epc has no fixup.
+uint64
+uaccess_fixup(uint64 epc)
+{
+  struct exception_table_entry *e;
+
+  for(e = __start___ex_table; e < __stop___ex_table; e++)
+    if(e->insn == epc)
+      return e->fixup;
+  return 0;
+}
+
+// may the current process hand the kernel [uaddr, uaddr+n)?
+// it must lie in user memory, and the kernel must be
+// running on the process's page table.
+static int
+access_ok(uint64 uaddr, uint64 n)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || p->kpagetable == 0)
+    return 0;
+  return uaddr < USERTOP && n <= USERTOP - uaddr;
+}
+
+// Copy n bytes to dst from user address usrc.
+// Return 0 on success, -EFAULT on error.
+int
+copy_from_user(void *dst, uint64 usrc, uint64 n)
+{
+  int r;
+
+  if(!access_ok(usrc, n))
+    return -EFAULT;
+  w_sstatus(r_sstatus() | SSTATUS_SUM);
+  r = __copy_user(dst, (void*)usrc, n);
+  w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+  return r < 0 ? -EFAULT : 0;
+}
+
+// Copy n bytes from src to user address udst.
+// Return 0 on success, -EFAULT on error.
+int
+copy_to_user(uint64 udst, void *src, uint64 n)
+{
+  int r;
+
+  if(!access_ok(udst, n))
+    return -EFAULT;
+  w_sstatus(r_sstatus() | SSTATUS_SUM);
+  r = __copy_user((void*)udst, src, n);
+  w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+  return r < 0 ? -EFAULT : 0;
+}
+
+// Copy a null-terminated string from user address usrc
+// to dst, copying at most max bytes.
+// Return its length, max if it is not terminated within
+// max bytes (dst is then not terminated either),
+// or -EFAULT on error.
+int
+strncpy_from_user(char *dst, uint64 usrc, int max)
+{
+  int r;
+
+  if(max <= 0)
+    return 0;
+  // the string may stop short of the end of user memory.
+  if(!access_ok(usrc, 1))
+    return -EFAULT;
+  if(max > USERTOP - usrc)
+    max = USERTOP - usrc;
+  w_sstatus(r_sstatus() | SSTATUS_SUM);
+  r = __strncpy_user(dst, (char*)usrc, max);
+  w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+  return r < 0 ? -EFAULT : r;
+}
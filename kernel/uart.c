@@ -8,6 +8,7 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "softirq.h"
 #include "defs.h"
 
 // the UART control registers are memory-mapped
@@ -45,9 +46,18 @@ char uart_tx_buf[UART_TX_BUF_SIZE];
 uint64 uart_tx_w; // write next to uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE]
 uint64 uart_tx_r; // read next from uart_tx_buf[uart_tx_r % UART_TX_BUF_SIZE]
 
+// the receive buffer, filled by uartintr() and
+// drained into the console by uartsoftirq().
+struct spinlock uart_rx_lock;
+#define UART_RX_BUF_SIZE 64
+char uart_rx_buf[UART_RX_BUF_SIZE];
+uint64 uart_rx_w; // write next to uart_rx_buf[uart_rx_w % UART_RX_BUF_SIZE]
+uint64 uart_rx_r; // read next from uart_rx_buf[uart_rx_r % UART_RX_BUF_SIZE]
+
 extern volatile int panicked; // from printf.c
 
 void uartstart();
+static void uartsoftirq(void);
 
 void
 uartinit(void)
@@ -75,6 +85,8 @@ uartinit(void)
   WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
 
   initlock(&uart_tx_lock, "uart");
+  initlock(&uart_rx_lock, "uart_rx");
+  open_softirq(SOFTIRQ_UART, uartsoftirq);
 }
 
 // add a character to the output buffer and tell the
@@ -103,6 +115,32 @@ uartputc(int c)
   release(&uart_tx_lock);
 }
 
+// like uartputc(), for n characters from a kernel buffer:
+// takes the lock and starts the uart once per buffer's
+// worth of output rather than once per character.
+void
+uartwrite(char *s, int n)
+{
+  acquire(&uart_tx_lock);
+
+  if(panicked){
+    for(;;)
+      ;
+  }
+  while(n > 0){
+    while(uart_tx_w == uart_tx_r + UART_TX_BUF_SIZE){
+      uartstart();
+      sleep(&uart_tx_r, &uart_tx_lock);
+    }
+    while(n > 0 && uart_tx_w != uart_tx_r + UART_TX_BUF_SIZE){
+      uart_tx_buf[uart_tx_w % UART_TX_BUF_SIZE] = *s++;
+      uart_tx_w += 1;
+      n--;
+    }
+  }
+  uartstart();
+  release(&uart_tx_lock);
+}
 
 // alternate version of uartputc() that doesn't 
 // use interrupts, for use by kernel printf() and
@@ -171,15 +209,49 @@ uartgetc(void)
 
 // handle a uart interrupt, raised because input has
 // arrived, or the uart is ready for more output, or
-// both. called from devintr().
+// both. called from devintr() with interrupts off, so
+// it only empties the receive FIFO and leaves console
+// processing and transmission to uartsoftirq().
 void
 uartintr(void)
 {
-  // read and process incoming characters.
+  int c;
+
+  // reading ISR acknowledges a transmit-ready interrupt.
+  ReadReg(ISR);
+
+  acquire(&uart_rx_lock);
+  while((c = uartgetc()) != -1){
+    // if the buffer is full, drop the character rather than
+    // leave it in the FIFO and take the interrupt again.
+    if(uart_rx_w != uart_rx_r + UART_RX_BUF_SIZE){
+      uart_rx_buf[uart_rx_w % UART_RX_BUF_SIZE] = c;
+      uart_rx_w += 1;
+    }
+  }
+  release(&uart_rx_lock);
+
+  raise_softirq(SOFTIRQ_UART);
+}
+
+// the bottom half of uartintr(), run on interrupt exit
+// with interrupts enabled.
+static void
+uartsoftirq(void)
+{
+  int c;
+
+  // process incoming characters.
   while(1){
-    int c = uartgetc();
-    if(c == -1)
+    acquire(&uart_rx_lock);
+    if(uart_rx_r == uart_rx_w){
+      release(&uart_rx_lock);
       break;
+    }
+    c = uart_rx_buf[uart_rx_r % UART_RX_BUF_SIZE];
+    uart_rx_r += 1;
+    release(&uart_rx_lock);
+
     consoleintr(c);
   }
 
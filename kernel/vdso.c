@@ -0,0 +1,59 @@
+//
+// keeping each process's vDSO page (see vdso.h) up to date.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "vdso.h"
+#include "defs.h"
+
+_Static_assert(__builtin_offsetof(struct vdso, time_offset) == VDSO_TIME_OFFSET &&
+               __builtin_offsetof(struct vdso, time_freq) == VDSO_TIME_FREQ,
+               "vdso.h offsets");
+
+extern uint64 timer_base;  // start.c
+
+static void
+vdso_write_begin(struct vdso *v)
+{
+  __atomic_store_n(&v->seq, v->seq + 1, __ATOMIC_RELAXED);
+  __sync_synchronize();
+}
+
+static void
+vdso_write_end(struct vdso *v)
+{
+  __sync_synchronize();
+  __atomic_store_n(&v->seq, v->seq + 1, __ATOMIC_RELAXED);
+}
+
+// fill in a new process's page.
+void
+vdso_init(struct vdso *v, struct proc *p)
+{
+  memset(v, 0, PGSIZE);
+  v->pid = p->pid;
+  v->hart = -1;
+  v->time_offset = timer_base;
+  v->time_pertick = TIMER_INTERVAL;
+  v->time_freq = CLINT_FREQ;
+}
+
+// called by the scheduler as p starts running on this hart.
+// p->lock must be held, so there is only one writer.
+void
+vdso_sethart(struct proc *p)
+{
+  struct vdso *v = p->vdso;
+  int hart = cpuid();
+
+  if(v->hart == hart)
+    return;
+  vdso_write_begin(v);
+  v->hart = hart;
+  vdso_write_end(v);
+}
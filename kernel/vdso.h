@@ -0,0 +1,30 @@
+//
+// the vDSO page: kernel-maintained data mapped read-only at
+// VDSO in every user address space, so that the stubs usys.pl
+// generates for getpid() and uptime() can answer without a
+// trap. each process has its own page.
+//
+// fields that can change while the process runs are written
+// under a sequence lock: seq is odd while the kernel writes,
+// and a reader retries if it saw an odd seq or if seq changed
+// while it read.
+//
+// offsets for the assembly stubs:
+#define VDSO_SEQ           0
+#define VDSO_PID           4
+#define VDSO_HART          8
+#define VDSO_TIME_OFFSET  16
+#define VDSO_TIME_PERTICK 24
+#define VDSO_TIME_FREQ    32
+
+#ifndef __ASSEMBLER__
+struct vdso {
+  /*  0 */ uint seq;
+  /*  4 */ int pid;
+  /*  8 */ int hart;            // the hart the process last started on
+  // ticks = (time - time_offset) / time_pertick.
+  /* 16 */ uint64 time_offset;  // time CSR value when ticks was 0
+  /* 24 */ uint64 time_pertick; // time CSR units per tick
+  /* 32 */ uint64 time_freq;    // time CSR units per second
+};
+#endif
@@ -0,0 +1,633 @@
+//
+// the virtio mmio transport: feature negotiation and
+// virtqueues, shared by virtio device drivers.
+//
+// with VIRTIO_RING_F_EVENT_IDX, each side tells the other
+// how far it has got instead of asking for every entry: a
+// driver's notify is written only if the device asked for
+// one at an index this batch passed, and the device
+// interrupts only once the used ring passes used_event.
+// with VIRTIO_RING_F_INDIRECT_DESC, a chain takes a single
+// ring descriptor, pointing at a table of its own.
+//
+// with VIRTIO_F_RING_PACKED, a queue is a single ring of
+// descriptors that the driver and device take turns to
+// write, instead of the split layout's descriptor table,
+// avail ring and used ring. the device reads and writes
+// one cache line per small request instead of three.
+// callers see the same virtq_*() functions either way.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "virtio.h"
+
+// the address of mmio register r of the device at base.
+#define R(base, r) ((volatile uint32 *)((base) + (r)))
+
+// the ring features the transport knows how to use.
+#define RING_FEATURES ((1UL << VIRTIO_RING_F_EVENT_IDX) | \
+                       (1UL << VIRTIO_RING_F_INDIRECT_DESC) | \
+                       (1UL << VIRTIO_F_RING_PACKED))
+
+// reset the device at base, check that it is a non-legacy
+// virtio device of type devid, and agree on the features in
+// wanted, or on the ring features, that it also offers.
+// returns the agreed features.
+uint64
+virtio_negotiate(uint64 base, int devid, uint64 wanted)
+{
+  uint32 status = 0;
+  uint64 features;
+
+  if(*R(base, VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
+     *R(base, VIRTIO_MMIO_VERSION) != 2 ||
+     *R(base, VIRTIO_MMIO_DEVICE_ID) != devid ||
+     *R(base, VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
+    panic("could not find virtio device");
+  }
+
+  // reset device
+  *R(base, VIRTIO_MMIO_STATUS) = status;
+
+  // set ACKNOWLEDGE status bit
+  status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
+  *R(base, VIRTIO_MMIO_STATUS) = status;
+
+  // set DRIVER status bit
+  status |= VIRTIO_CONFIG_S_DRIVER;
+  *R(base, VIRTIO_MMIO_STATUS) = status;
+
+  // negotiate features. VIRTIO_F_VERSION_1 is required
+  // of a non-legacy device.
+  *R(base, VIRTIO_MMIO_DEVICE_FEATURES_SEL) = 0;
+  features = *R(base, VIRTIO_MMIO_DEVICE_FEATURES);
+  *R(base, VIRTIO_MMIO_DEVICE_FEATURES_SEL) = 1;
+  features |= (uint64)*R(base, VIRTIO_MMIO_DEVICE_FEATURES) << 32;
+  if((features & (1UL << VIRTIO_F_VERSION_1)) == 0)
+    panic("virtio device is legacy");
+  features &= wanted | RING_FEATURES | (1UL << VIRTIO_F_VERSION_1);
+  *R(base, VIRTIO_MMIO_DRIVER_FEATURES_SEL) = 0;
+  *R(base, VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  *R(base, VIRTIO_MMIO_DRIVER_FEATURES_SEL) = 1;
+  *R(base, VIRTIO_MMIO_DRIVER_FEATURES) = features >> 32;
+
+  // tell device that feature negotiation is complete.
+  status |= VIRTIO_CONFIG_S_FEATURES_OK;
+  *R(base, VIRTIO_MMIO_STATUS) = status;
+
+  // re-read status to ensure FEATURES_OK is set.
+  status = *R(base, VIRTIO_MMIO_STATUS);
+  if(!(status & VIRTIO_CONFIG_S_FEATURES_OK))
+    panic("virtio FEATURES_OK unset");
+
+  return features;
+}
+
+// tell the device at base we're completely ready.
+void
+virtio_ready(uint64 base)
+{
+  *R(base, VIRTIO_MMIO_STATUS) |= VIRTIO_CONFIG_S_DRIVER_OK;
+}
+
+// set up queue id of the device at base, using the ring
+// features among the negotiated features.
+void
+virtq_init(struct virtq *q, uint64 base, int id, uint64 features)
+{
+  char *page;
+  int i;
+
+  initlock(&q->lock, "virtq");
+  q->base = base;
+  q->id = id;
+  q->event_idx = (features & (1UL << VIRTIO_RING_F_EVENT_IDX)) != 0;
+  q->packed = (features & (1UL << VIRTIO_F_RING_PACKED)) != 0;
+  q->polling = 0;
+
+  *R(base, VIRTIO_MMIO_QUEUE_SEL) = id;
+
+  // ensure the queue is not in use.
+  if(*R(base, VIRTIO_MMIO_QUEUE_READY))
+    panic("virtq should not be ready");
+
+  // check maximum queue size.
+  uint32 max = *R(base, VIRTIO_MMIO_QUEUE_NUM_MAX);
+  if(max == 0)
+    panic("virtq missing");
+  if(max < NUM)
+    panic("virtq max queue too short");
+
+  // allocate and zero queue memory.
+  q->desc = kalloc();
+  q->avail = kalloc();
+  q->used = kalloc();
+  if(!q->desc || !q->avail || !q->used)
+    panic("virtq kalloc");
+  memset(q->desc, 0, PGSIZE);
+  memset(q->avail, 0, PGSIZE);
+  memset(q->used, 0, PGSIZE);
+
+  // set queue size.
+  *R(base, VIRTIO_MMIO_QUEUE_NUM) = NUM;
+
+  // write physical addresses.
+  *R(base, VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)q->desc;
+  *R(base, VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)q->desc >> 32;
+  *R(base, VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)q->avail;
+  *R(base, VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)q->avail >> 32;
+  *R(base, VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)q->used;
+  *R(base, VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)q->used >> 32;
+
+  // all NUM descriptors, and for a packed queue all
+  // NUM buffer ids, start out unused. a packed queue's
+  // ring is desc's page, and must stay zeroed until
+  // packed_add() writes it.
+  for(i = 0; i < NUM; i++){
+    if(!q->packed)
+      q->desc[i].next = i + 1;
+    q->idnext[i] = i + 1;
+    q->data[i] = 0;
+    q->ind[i] = -1;
+  }
+  q->free_head = 0;
+  q->nfree = NUM;
+  q->avail_idx = q->kicked_idx = q->used_idx = 0;
+  q->nkick = 0;
+
+  // the driver's and device's wrap counters both start
+  // at 1, so that the zeroed ring reads as all unused.
+  q->ring = (struct pvirtq_desc*)q->desc;
+  q->driver_event = (struct pvirtq_event*)q->avail;
+  q->device_event = (struct pvirtq_event*)q->used;
+  q->avail_wrap = 1;
+  q->used_wrap = 1;
+  q->nadded = 0;
+
+  // indirect tables, several to a page.
+  q->nindfree = 0;
+  if(features & (1UL << VIRTIO_RING_F_INDIRECT_DESC)){
+    page = 0;
+    for(i = 0; i < NINDTAB; i++){
+      if(i % (PGSIZE / (INDIRECT_MAX * sizeof(struct virtq_desc))) == 0 &&
+         (page = kalloc()) == 0)
+        panic("virtq kalloc");
+      q->indtab[i] = (struct virtq_desc*)page +
+        i % (PGSIZE / (INDIRECT_MAX * sizeof(struct virtq_desc))) * INDIRECT_MAX;
+      q->indfree[q->nindfree++] = i;
+    }
+  }
+
+  // queue is ready.
+  *R(base, VIRTIO_MMIO_QUEUE_READY) = 0x1;
+}
+
+// take an indirect table off the free stack, or -1.
+static int
+alloc_ind(struct virtq *q)
+{
+  if(q->nindfree == 0)
+    return -1;
+  return q->indfree[--q->nindfree];
+}
+
+// put chain i's indirect table, if any, back.
+static void
+free_ind(struct virtq *q, int i)
+{
+  if(q->ind[i] >= 0){
+    q->indfree[q->nindfree++] = q->ind[i];
+    q->ind[i] = -1;
+  }
+}
+
+//
+// split virtqueues.
+//
+
+// take a descriptor off the free list.
+// caller has checked nfree.
+static int
+alloc_desc(struct virtq *q)
+{
+  int i = q->free_head;
+
+  q->free_head = q->desc[i].next;
+  q->nfree--;
+  return i;
+}
+
+// free the chain at head, and its indirect table.
+static void
+free_chain(struct virtq *q, int i)
+{
+  int flag, nxt;
+
+  q->data[i] = 0;
+  free_ind(q, i);
+  while(1){
+    flag = q->desc[i].flags;
+    nxt = q->desc[i].next;
+    q->desc[i].addr = 0;
+    q->desc[i].len = 0;
+    q->desc[i].flags = 0;
+    q->desc[i].next = q->free_head;
+    q->free_head = i;
+    q->nfree++;
+    if(flag & VRING_DESC_F_NEXT)
+      i = nxt;
+    else
+      break;
+  }
+}
+
+// fill in n chained descriptors in table d, at the
+// indices in idx: first the nout buffers the device
+// reads, then the ones it writes.
+static void
+fill_chain(struct virtq_desc *d, int *idx, struct virtq_buf *bufs, int n, int nout)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    d[idx[i]].addr = bufs[i].addr;
+    d[idx[i]].len = bufs[i].len;
+    d[idx[i]].flags = i >= nout ? VRING_DESC_F_WRITE : 0;
+    if(i + 1 < n){
+      d[idx[i]].flags |= VRING_DESC_F_NEXT;
+      d[idx[i]].next = idx[i + 1];
+    } else
+      d[idx[i]].next = 0;
+  }
+}
+
+static int
+split_add(struct virtq *q, struct virtq_buf *bufs, int nout, int nin, void *data)
+{
+  int idx[INDIRECT_MAX];
+  int n, i, head, t;
+
+  n = nout + nin;
+  if(n > 1 && q->nfree >= 1 && (t = alloc_ind(q)) >= 0){
+    // one ring descriptor, pointing at a table.
+    for(i = 0; i < n; i++)
+      idx[i] = i;
+    fill_chain(q->indtab[t], idx, bufs, n, nout);
+    head = alloc_desc(q);
+    q->desc[head].addr = (uint64)q->indtab[t];
+    q->desc[head].len = n * sizeof(struct virtq_desc);
+    q->desc[head].flags = VRING_DESC_F_INDIRECT;
+    q->desc[head].next = 0;
+    q->ind[head] = t;
+  } else {
+    if(q->nfree < n)
+      return -1;
+    for(i = 0; i < n; i++)
+      idx[i] = alloc_desc(q);
+    fill_chain(q->desc, idx, bufs, n, nout);
+    head = idx[0];
+  }
+
+  q->data[head] = data;
+  q->avail->ring[q->avail_idx % NUM] = head;
+  q->avail_idx++;
+  return 0;
+}
+
+static int
+split_kick(struct virtq *q)
+{
+  uint16 old, new;
+
+  old = q->kicked_idx;
+  new = q->avail_idx;
+  if(old == new)
+    return 0;
+
+  // tell the device another avail ring entry is available.
+  __sync_synchronize();
+  q->avail->idx = new;
+  __sync_synchronize();
+
+  q->kicked_idx = new;
+  if(q->event_idx)
+    return vring_need_event(q->used->avail_event, new, old);
+  return (q->used->flags & VRING_USED_F_NO_NOTIFY) == 0;
+}
+
+static int
+split_pending(struct virtq *q)
+{
+  // the device increments q->used->idx when it
+  // adds an entry to the used ring.
+  return q->used_idx != q->used->idx;
+}
+
+static void*
+split_get(struct virtq *q, uint32 *len)
+{
+  void *data;
+  int id;
+
+  __sync_synchronize();
+  id = q->used->ring[q->used_idx % NUM].id;
+  if(len)
+    *len = q->used->ring[q->used_idx % NUM].len;
+  data = q->data[id];
+  free_chain(q, id);
+  q->used_idx += 1;
+
+  // with EVENT_IDX, interrupt again for the next entry.
+  if(q->event_idx && !q->polling)
+    q->avail->used_event = q->used_idx;
+  return data;
+}
+
+static void
+split_disable_cb(struct virtq *q)
+{
+  if(q->event_idx){
+    // as far from used_idx as the ring index goes.
+    q->avail->used_event = q->used_idx - 0x8000;
+  } else
+    q->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+}
+
+static void
+split_enable_cb(struct virtq *q)
+{
+  if(q->event_idx)
+    q->avail->used_event = q->used_idx;
+  else
+    q->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+}
+
+//
+// packed virtqueues.
+//
+
+// the AVAIL and USED flag bits that make a descriptor
+// available in the current lap of the ring.
+static uint16
+packed_avail_flags(struct virtq *q)
+{
+  return q->avail_wrap ? VRING_PACKED_DESC_F_AVAIL : VRING_PACKED_DESC_F_USED;
+}
+
+static int
+packed_add(struct virtq *q, struct virtq_buf *bufs, int nout, int nin, void *data)
+{
+  struct pvirtq_desc *d, *tab;
+  uint16 id, flags, headflags;
+  int n, i, head, t, nring;
+
+  n = nout + nin;
+  t = -1;
+  if(q->free_head == NUM)
+    return -1;
+  if(n > 1 && q->nfree >= 1)
+    t = alloc_ind(q);
+  nring = t >= 0 ? 1 : n;
+  if(q->nfree < nring){
+    if(t >= 0)
+      q->indfree[q->nindfree++] = t;
+    return -1;
+  }
+
+  id = q->free_head;
+  q->free_head = q->idnext[id];
+  q->data[id] = data;
+  q->ind[id] = t;
+  q->ndesc[id] = nring;
+  q->nfree -= nring;
+
+  head = q->avail_idx;
+  headflags = 0;
+  tab = 0;
+  if(t >= 0){
+    // an indirect table is a plain array; its descriptors'
+    // ids and AVAIL/USED bits mean nothing.
+    tab = (struct pvirtq_desc*)q->indtab[t];
+    for(i = 0; i < n; i++){
+      tab[i].addr = bufs[i].addr;
+      tab[i].len = bufs[i].len;
+      tab[i].id = 0;
+      tab[i].flags = i >= nout ? VRING_DESC_F_WRITE : 0;
+    }
+  }
+
+  for(i = 0; i < nring; i++){
+    d = &q->ring[q->avail_idx];
+    if(t >= 0){
+      d->addr = (uint64)tab;
+      d->len = n * sizeof(struct pvirtq_desc);
+    } else {
+      d->addr = bufs[i].addr;
+      d->len = bufs[i].len;
+    }
+    d->id = id;
+    flags = packed_avail_flags(q);
+    if(t >= 0)
+      flags |= VRING_DESC_F_INDIRECT;
+    else if(i >= nout)
+      flags |= VRING_DESC_F_WRITE;
+    if(i + 1 < nring)
+      flags |= VRING_DESC_F_NEXT;
+    // the head's flags go in last, so the device can't
+    // see a partly written chain.
+    if(i == 0)
+      headflags = flags;
+    else
+      d->flags = flags;
+    if(++q->avail_idx == NUM){
+      q->avail_idx = 0;
+      q->avail_wrap ^= 1;
+    }
+  }
+  __sync_synchronize();
+  q->ring[head].flags = headflags;
+
+  q->nadded += nring;
+  return 0;
+}
+
+static int
+packed_kick(struct virtq *q)
+{
+  uint16 old, new, event;
+  int flags, off_wrap;
+
+  if(q->nadded == 0)
+    return 0;
+  new = q->avail_idx;
+  old = new - q->nadded;
+  q->nadded = 0;
+
+  // the descriptors must be visible before we
+  // read what the device wants.
+  __sync_synchronize();
+  flags = q->device_event->flags;
+  off_wrap = q->device_event->off_wrap;
+  if(flags != RING_EVENT_FLAGS_DESC)
+    return flags != RING_EVENT_FLAGS_DISABLE;
+
+  // an offset from the ring's previous lap
+  // counts from NUM back.
+  event = off_wrap & 0x7fff;
+  if((off_wrap >> 15) != q->avail_wrap)
+    event -= NUM;
+  return vring_need_event(event, new, old);
+}
+
+static int
+packed_pending(struct virtq *q)
+{
+  uint16 flags = q->ring[q->used_idx].flags;
+  int avail = (flags & VRING_PACKED_DESC_F_AVAIL) != 0;
+  int used = (flags & VRING_PACKED_DESC_F_USED) != 0;
+
+  return avail == used && used == q->used_wrap;
+}
+
+// the device's used-event position: our next used
+// offset, and its lap.
+static uint16
+packed_used_event(struct virtq *q)
+{
+  return q->used_idx | q->used_wrap << 15;
+}
+
+static void*
+packed_get(struct virtq *q, uint32 *len)
+{
+  struct pvirtq_desc *d;
+  void *data;
+  uint16 id;
+
+  __sync_synchronize();
+  d = &q->ring[q->used_idx];
+  id = d->id;
+  if(len)
+    *len = d->len;
+  data = q->data[id];
+  q->data[id] = 0;
+  free_ind(q, id);
+
+  // the chain's descriptors are all free again, though
+  // the device wrote only the first of them.
+  q->nfree += q->ndesc[id];
+  q->used_idx += q->ndesc[id];
+  if(q->used_idx >= NUM){
+    q->used_idx -= NUM;
+    q->used_wrap ^= 1;
+  }
+  q->idnext[id] = q->free_head;
+  q->free_head = id;
+
+  // with EVENT_IDX, interrupt again for the next entry.
+  if(q->event_idx && !q->polling)
+    q->driver_event->off_wrap = packed_used_event(q);
+  return data;
+}
+
+static void
+packed_disable_cb(struct virtq *q)
+{
+  q->driver_event->flags = RING_EVENT_FLAGS_DISABLE;
+}
+
+static void
+packed_enable_cb(struct virtq *q)
+{
+  if(q->event_idx){
+    q->driver_event->off_wrap = packed_used_event(q);
+    __sync_synchronize();
+    q->driver_event->flags = RING_EVENT_FLAGS_DESC;
+  } else
+    q->driver_event->flags = RING_EVENT_FLAGS_ENABLE;
+}
+
+//
+// the interface for drivers.
+//
+
+// queue a chain of the nout buffers in bufs the device
+// reads followed by the nin it writes, to be returned
+// with data by virtq_get(). the device doesn't see it
+// until virtq_kick(). returns -1 if there isn't room.
+int
+virtq_add(struct virtq *q, struct virtq_buf *bufs, int nout, int nin, void *data)
+{
+  if(nout + nin < 1 || nout + nin > INDIRECT_MAX)
+    panic("virtq_add");
+  if(q->packed)
+    return packed_add(q, bufs, nout, nin, data);
+  return split_add(q, bufs, nout, nin, data);
+}
+
+// let the device see the chains added since the last
+// kick, and notify it unless it has said it doesn't need
+// to hear about them. returns 1 if it notified.
+int
+virtq_kick(struct virtq *q)
+{
+  int need;
+
+  need = q->packed ? packed_kick(q) : split_kick(q);
+  if(need){
+    *R(q->base, VIRTIO_MMIO_QUEUE_NOTIFY) = q->id; // value is queue number
+    q->nkick++;
+  }
+  return need;
+}
+
+// whether the device has used chains that virtq_get()
+// hasn't returned yet. may be called without the lock,
+// as a hint.
+int
+virtq_pending(struct virtq *q)
+{
+  return q->packed ? packed_pending(q) : split_pending(q);
+}
+
+// the token of the next chain the device has used, or 0 if
+// there are none. *len is how much the device wrote.
+void*
+virtq_get(struct virtq *q, uint32 *len)
+{
+  if(!virtq_pending(q))
+    return 0;
+  return q->packed ? packed_get(q, len) : split_get(q, len);
+}
+
+// stop the device interrupting for this queue, while the
+// driver polls it.
+void
+virtq_disable_cb(struct virtq *q)
+{
+  q->polling = 1;
+  if(q->packed)
+    packed_disable_cb(q);
+  else
+    split_disable_cb(q);
+}
+
+// let the device interrupt for this queue again. returns 1
+// if it used more chains before it could see that, so that
+// the driver must keep polling.
+int
+virtq_enable_cb(struct virtq *q)
+{
+  q->polling = 0;
+  if(q->packed)
+    packed_enable_cb(q);
+  else
+    split_enable_cb(q);
+  __sync_synchronize();
+  return virtq_pending(q);
+}
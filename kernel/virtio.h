@@ -0,0 +1,213 @@
+//
+// virtio device definitions.
+// for both the mmio interface, and virtio descriptors.
+// only tested with qemu.
+//
+// the virtio spec:
+// https://docs.oasis-open.org/virtio/virtio/v1.1/virtio-v1.1.pdf
+//
+
+// virtio mmio control registers, mapped starting at 0x10001000.
+// from qemu virtio_mmio.h. these are the non-legacy (version 2)
+// registers; the Makefile runs qemu with force-legacy=false.
+#define VIRTIO_MMIO_MAGIC_VALUE		0x000 // 0x74726976
+#define VIRTIO_MMIO_VERSION		0x004 // version; should be 2
+#define VIRTIO_MMIO_DEVICE_ID		0x008 // device type; 1 is net, 2 is disk
+#define VIRTIO_MMIO_VENDOR_ID		0x00c // 0x554d4551
+#define VIRTIO_MMIO_DEVICE_FEATURES	0x010
+#define VIRTIO_MMIO_DEVICE_FEATURES_SEL	0x014 // which 32 feature bits
+#define VIRTIO_MMIO_DRIVER_FEATURES	0x020
+#define VIRTIO_MMIO_DRIVER_FEATURES_SEL	0x024
+#define VIRTIO_MMIO_QUEUE_SEL		0x030 // select queue, write-only
+#define VIRTIO_MMIO_QUEUE_NUM_MAX	0x034 // max size of current queue, read-only
+#define VIRTIO_MMIO_QUEUE_NUM		0x038 // size of current queue, write-only
+#define VIRTIO_MMIO_QUEUE_READY		0x044 // ready bit
+#define VIRTIO_MMIO_QUEUE_NOTIFY	0x050 // write-only
+#define VIRTIO_MMIO_INTERRUPT_STATUS	0x060 // read-only
+#define VIRTIO_MMIO_INTERRUPT_ACK	0x064 // write-only
+#define VIRTIO_MMIO_STATUS		0x070 // read/write
+#define VIRTIO_MMIO_QUEUE_DESC_LOW	0x080 // physical address for descriptor table, write-only
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH	0x084
+#define VIRTIO_MMIO_DRIVER_DESC_LOW	0x090 // physical address for available ring, write-only
+#define VIRTIO_MMIO_DRIVER_DESC_HIGH	0x094
+#define VIRTIO_MMIO_DEVICE_DESC_LOW	0x0a0 // physical address for used ring, write-only
+#define VIRTIO_MMIO_DEVICE_DESC_HIGH	0x0a4
+#define VIRTIO_MMIO_CONFIG		0x100 // device-specific configuration
+
+// status register bits, from qemu virtio_config.h
+#define VIRTIO_CONFIG_S_ACKNOWLEDGE	1
+#define VIRTIO_CONFIG_S_DRIVER		2
+#define VIRTIO_CONFIG_S_DRIVER_OK	4
+#define VIRTIO_CONFIG_S_FEATURES_OK	8
+
+// device feature bits
+#define VIRTIO_BLK_F_RO              5	/* Disk is read-only */
+#define VIRTIO_BLK_F_SCSI            7	/* Supports scsi command passthru */
+#define VIRTIO_BLK_F_FLUSH           9	/* Cache flush command support */
+#define VIRTIO_BLK_F_CONFIG_WCE     11	/* Writeback mode available in config */
+#define VIRTIO_BLK_F_MQ             12	/* support more than one vq */
+#define VIRTIO_F_ANY_LAYOUT         27
+#define VIRTIO_RING_F_INDIRECT_DESC 28
+#define VIRTIO_RING_F_EVENT_IDX     29
+#define VIRTIO_F_VERSION_1          32	/* non-legacy device */
+#define VIRTIO_F_RING_PACKED        34	/* packed virtqueue layout */
+
+// this many virtio descriptors per queue.
+// must be a power of two, and at most QUEUE_NUM_MAX;
+// 256 descriptors fill the descriptor table's page.
+#define NUM 256
+
+// a single descriptor, from the spec.
+struct virtq_desc {
+  uint64 addr;
+  uint32 len;
+  uint16 flags;
+  uint16 next;
+};
+#define VRING_DESC_F_NEXT     1 // chained with another descriptor
+#define VRING_DESC_F_WRITE    2 // device writes (vs read)
+#define VRING_DESC_F_INDIRECT 4 // addr is a table of descriptors
+
+// the (entire) avail ring, from the spec.
+struct virtq_avail {
+  uint16 flags; // VRING_AVAIL_F_NO_INTERRUPT
+  uint16 idx;   // driver will write ring[idx] next
+  uint16 ring[NUM]; // descriptor numbers of chain heads
+  uint16 used_event; // with EVENT_IDX: interrupt after this entry
+};
+#define VRING_AVAIL_F_NO_INTERRUPT 1
+
+// one entry in the "used" ring, with which the
+// device tells the driver about completed requests.
+struct virtq_used_elem {
+  uint32 id;   // index of start of completed descriptor chain
+  uint32 len;
+};
+
+struct virtq_used {
+  uint16 flags; // VRING_USED_F_NO_NOTIFY
+  uint16 idx;   // device increments when it adds a ring[] entry
+  struct virtq_used_elem ring[NUM];
+  uint16 avail_event; // with EVENT_IDX: notify after this entry
+};
+#define VRING_USED_F_NO_NOTIFY 1
+
+// a descriptor in a packed virtqueue, section 2.7 of the
+// spec. there is just the one ring: the driver writes
+// descriptors into it with AVAIL and USED set to show they
+// are available, and the device overwrites them with the
+// chains it has used, with both set the same.
+struct pvirtq_desc {
+  uint64 addr;
+  uint32 len;
+  uint16 id;    // buffer id, returned in the used descriptor
+  uint16 flags; // VRING_DESC_F_*, and the two below
+};
+#define VRING_PACKED_DESC_F_AVAIL (1 << 7)
+#define VRING_PACKED_DESC_F_USED  (1 << 15)
+
+// the driver and device event suppression areas of a
+// packed virtqueue, where each says when it wants to
+// hear about the other's descriptors.
+struct pvirtq_event {
+  uint16 off_wrap; // with RING_EVENT_FLAGS_DESC: ring offset,
+                   // and wrap counter in bit 15
+  uint16 flags;
+};
+#define RING_EVENT_FLAGS_ENABLE  0
+#define RING_EVENT_FLAGS_DISABLE 1
+#define RING_EVENT_FLAGS_DESC    2 // only with EVENT_IDX
+
+// with EVENT_IDX, whether moving an index from old to new
+// has passed event, in which case the other side wants to
+// hear about it.
+#define vring_need_event(event, new, old) \
+  ((uint16)((new) - (event) - 1) < (uint16)((new) - (old)))
+
+// indirect descriptor tables per queue, and the most
+// descriptors in one. a chain that doesn't fit, or finds
+// none free, uses ring descriptors directly.
+#define NINDTAB      64
+#define INDIRECT_MAX 32
+
+// one buffer to add to a virtqueue.
+struct virtq_buf {
+  uint64 addr;
+  uint32 len;
+};
+
+// a virtqueue, as the transport in virtio.c keeps it.
+// callers hold lock around the virtq_*() functions.
+struct virtq {
+  struct spinlock lock;
+  uint64 base;     // the device's mmio registers
+  int id;          // queue number, for QUEUE_SEL and QUEUE_NOTIFY
+  int event_idx;   // VIRTIO_RING_F_EVENT_IDX was negotiated
+  int packed;      // VIRTIO_F_RING_PACKED was negotiated
+  int polling;     // interrupts are off; the driver is polling
+
+  // the three parts of the virtqueue, each in a page of its
+  // own: the descriptor table, where the driver describes
+  // requests; the avail ring, where it hands chains to the
+  // device; and the used ring, where the device returns them.
+  struct virtq_desc *desc;
+  struct virtq_avail *avail;
+  struct virtq_used *used;
+
+  // free descriptors, linked through their next fields.
+  uint16 free_head;
+  int nfree;
+
+  uint16 avail_idx;  // avail->idx, including unpublished chains
+  uint16 kicked_idx; // avail->idx at the last notify
+  uint16 used_idx;   // we've looked this far in used->ring.
+
+  // per chain, by the index of its first descriptor:
+  // the caller's token, and its indirect table or -1.
+  void *data[NUM];
+  short ind[NUM];
+
+  // a packed queue uses desc's page for its ring, and
+  // avail's and used's for the driver and device event
+  // areas. avail_idx and used_idx are then ring offsets,
+  // each with a wrap counter, and the per-chain arrays
+  // are by buffer id. the free ids are linked through
+  // idnext, starting at free_head.
+  struct pvirtq_desc *ring;
+  struct pvirtq_event *driver_event;
+  struct pvirtq_event *device_event;
+  int avail_wrap;
+  int used_wrap;
+  uint16 nadded;     // descriptors made available since the last kick
+  uint16 idnext[NUM];
+  uint16 ndesc[NUM]; // ring descriptors each chain took
+
+  // indirect tables, if VIRTIO_RING_F_INDIRECT_DESC was
+  // negotiated, and a stack of the free ones.
+  struct virtq_desc *indtab[NINDTAB];
+  uchar indfree[NINDTAB];
+  int nindfree;
+
+  uint64 nkick;      // notifies written
+};
+
+// these are specific to virtio block devices, e.g. disks,
+// described in Section 5.2 of the spec.
+
+#define VIRTIO_BLK_T_IN  0 // read the disk
+#define VIRTIO_BLK_T_OUT 1 // write the disk
+#define VIRTIO_BLK_T_FLUSH 4 // flush the disk's write cache
+
+// the format of the first descriptor in a disk request.
+// to be followed by descriptors for the data,
+// and then one for a 1-byte status result.
+struct virtio_blk_req {
+  uint32 type; // VIRTIO_BLK_T_IN or ..._OUT
+  uint32 reserved;
+  uint64 sector;
+};
+
+// the start of the device configuration space at
+// VIRTIO_MMIO_CONFIG, for block devices.
+#define VIRTIO_BLK_CONFIG_CAPACITY 0x00 // uint64, in 512-byte sectors
+#define VIRTIO_BLK_CONFIG_NUM_QUEUES 0x22 // uint16, with VIRTIO_BLK_F_MQ
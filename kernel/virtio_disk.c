@@ -0,0 +1,353 @@
+//
+// driver for qemu's virtio disk device.
+// uses qemu's mmio interface to virtio, non-legacy.
+//
+// qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0,num-queues=N
+//
+// each virtqueue is NUM descriptors deep, and requests are
+// asynchronous: virtio_disk_submit() turns a batch of
+// scatter-gather requests into descriptor chains and tells
+// the device about all of them with one notify, then returns
+// without waiting. the device completes them in any order;
+// the interrupt hands the used ring to the disk softirq,
+// which finishes each request and calls its done function
+// or wakes blk_wait().
+//
+// if the device offers VIRTIO_BLK_F_MQ, there is a virtqueue
+// per hart, each with its own lock. a hart submits to its
+// own queue and completes from it, so harts doing I/O at the
+// same time don't share a lock or a ring. an mmio device has
+// only the one interrupt line for all its queues, though, so
+// the hart that takes the interrupt finishes its own queue
+// and hands the others to their owners' disk workers.
+//
+// the ring work is in the virtio transport, virtio.c. under
+// load, a queue is polled NAPI-style: once an interrupt
+// starts the bottom half, it turns the queue's interrupts
+// off and keeps polling for as long as each pass finds a
+// full budget of completions, then turns them back on.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "softirq.h"
+#include "workqueue.h"
+#include "virtio.h"
+#include "blk.h"
+#include "errno.h"
+
+// the address of virtio mmio register r.
+#define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
+
+// completions to take per poll of a queue. a queue that
+// has this many each time stays polled, with interrupts off.
+#define DISK_BUDGET 16
+
+// a request in flight: its header, and the status
+// the device writes.
+struct diskslot {
+  struct virtio_blk_req hdr;
+  struct blkreq *r;
+  uint8 status;
+  struct diskslot *next; // on the queue's free list
+};
+
+static struct diskq {
+  struct virtq vq;
+  struct diskslot slot[NUM];
+  struct diskslot *free;
+  uint64 nio;            // requests completed
+} queues[NCPU];          // queue i belongs to hart i
+
+static struct {
+  int nq;
+  int flush;              // VIRTIO_BLK_F_FLUSH was negotiated
+  struct work work[NCPU]; // polls queues[i] on hart i
+  uint64 nintr;           // interrupts the device raised
+} disk;
+
+static uint64 capacity; // in sectors
+
+static void virtio_disk_softirq(void);
+static void virtio_disk_work(struct work*);
+
+void
+virtio_disk_init(void)
+{
+  uint64 features;
+  struct diskq *dq;
+  int i, j;
+
+  features = virtio_negotiate(VIRTIO0, 2,
+                              (1UL << VIRTIO_BLK_F_MQ) | (1UL << VIRTIO_BLK_F_FLUSH));
+  disk.flush = (features & (1UL << VIRTIO_BLK_F_FLUSH)) != 0;
+
+  // a queue per hart, or as many as the device has.
+  disk.nq = 1;
+  if(features & (1UL << VIRTIO_BLK_F_MQ))
+    disk.nq = *(volatile uint16 *)R(VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CONFIG_NUM_QUEUES);
+  if(disk.nq < 1)
+    disk.nq = 1;
+  if(disk.nq > NCPU)
+    disk.nq = NCPU;
+  for(i = 0; i < disk.nq; i++){
+    dq = &queues[i];
+    virtq_init(&dq->vq, VIRTIO0, i, features);
+    dq->free = 0;
+    for(j = 0; j < NUM; j++){
+      dq->slot[j].next = dq->free;
+      dq->free = &dq->slot[j];
+    }
+    initwork(&disk.work[i], virtio_disk_work);
+  }
+
+  capacity = *R(VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CONFIG_CAPACITY) |
+    (uint64)*R(VIRTIO_MMIO_CONFIG + VIRTIO_BLK_CONFIG_CAPACITY + 4) << 32;
+
+  open_softirq(SOFTIRQ_DISK, virtio_disk_softirq);
+
+  virtio_ready(VIRTIO0);
+
+  printf("virtio disk: %d %s queues%s%s%s\n", disk.nq,
+         features & (1UL << VIRTIO_F_RING_PACKED) ? "packed" : "split",
+         features & (1UL << VIRTIO_RING_F_EVENT_IDX) ? ", event idx" : "",
+         features & (1UL << VIRTIO_RING_F_INDIRECT_DESC) ? ", indirect" : "",
+         disk.flush ? ", write cache" : "");
+
+  // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
+}
+
+// the size of the disk, in sectors.
+uint64
+virtio_disk_capacity(void)
+{
+  return capacity;
+}
+
+// requests completed, notifies written, and
+// interrupts taken, since boot.
+void
+virtio_disk_stats(uint64 *nio, uint64 *nkick, uint64 *nintr)
+{
+  int i;
+
+  *nio = *nkick = 0;
+  for(i = 0; i < disk.nq; i++){
+    *nio += queues[i].nio;
+    *nkick += queues[i].vq.nkick;
+  }
+  *nintr = disk.nintr;
+}
+
+// add r to dq as a chain: the header, one buffer per
+// segment, and the status byte. returns -1 if there
+// isn't room. caller holds dq->vq.lock.
+static int
+virtio_disk_add(struct diskq *dq, struct blkreq *r)
+{
+  struct virtq_buf bufs[BLKMAXSEG + 2];
+  struct diskslot *s;
+  int i;
+
+  if((s = dq->free) == 0)
+    return -1;
+  if(r->write == BLKFLUSH)
+    s->hdr.type = VIRTIO_BLK_T_FLUSH;
+  else
+    s->hdr.type = r->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  s->hdr.reserved = 0;
+  s->hdr.sector = r->sector;
+  s->status = 0xff; // device writes 0 on success
+  s->r = r;
+
+  bufs[0].addr = (uint64)&s->hdr;
+  bufs[0].len = sizeof(struct virtio_blk_req);
+  for(i = 0; i < r->nseg; i++){
+    bufs[1 + i].addr = (uint64)r->seg[i].addr;
+    bufs[1 + i].len = r->seg[i].len;
+  }
+  bufs[1 + i].addr = (uint64)&s->status;
+  bufs[1 + i].len = 1;
+
+  // the device reads the header and a write's data, and
+  // writes a read's data and the status.
+  if(virtq_add(&dq->vq, bufs, r->write ? 1 + r->nseg : 1,
+               r->write ? 1 : r->nseg + 1, s) < 0)
+    return -1;
+  dq->free = s->next;
+  return 0;
+}
+
+// start the n requests in reqs on this hart's queue, and
+// return without waiting for them. sleeps if the queue is
+// too full to take them all, so the caller must be a process.
+// the device is notified at most once for the whole batch.
+void
+virtio_disk_submit(struct blkreq **reqs, int n)
+{
+  struct diskq *dq;
+  struct blkreq *r;
+  int i;
+
+  // if the caller moves to another hart from here on, it
+  // just keeps using this queue until it's done.
+  push_off();
+  dq = &queues[cpuid() % disk.nq];
+  pop_off();
+
+  acquire(&dq->vq.lock);
+  for(i = 0; i < n; i++){
+    r = reqs[i];
+    if((r->nseg < 1 && r->write != BLKFLUSH) || r->nseg > BLKMAXSEG)
+      panic("virtio_disk_submit");
+    r->status = 0;
+    r->complete = 0;
+    r->queue = dq->vq.id;
+    while(virtio_disk_add(dq, r) < 0){
+      // let the device at what we have before waiting
+      // for it to free some descriptors.
+      virtq_kick(&dq->vq);
+      sleep(dq, &dq->vq.lock);
+    }
+  }
+  virtq_kick(&dq->vq);
+  release(&dq->vq.lock);
+}
+
+// wait for r, which has no done function, to complete.
+// returns its status.
+int
+blk_wait(struct blkreq *r)
+{
+  struct virtq *q = &queues[r->queue].vq;
+
+  acquire(&q->lock);
+  while(!r->complete)
+    sleep(r, &q->lock);
+  release(&q->lock);
+  return r->status;
+}
+
+// read or write r, and wait for it.
+int
+virtio_disk_rw(struct blkreq *r)
+{
+  r->done = 0;
+  virtio_disk_submit(&r, 1);
+  return blk_wait(r);
+}
+
+// make the writes that have completed durable, if the
+// device caches them. returns 0, or -EIO.
+int
+virtio_disk_flush(void)
+{
+  struct blkreq r;
+
+  if(!disk.flush)
+    return 0;
+  r.write = BLKFLUSH;
+  r.sector = 0;
+  r.nseg = 0;
+  return virtio_disk_rw(&r);
+}
+
+void
+virtio_disk_intr(void)
+{
+  // the device won't raise another interrupt until we tell it
+  // we've seen this one, which the following line does.
+  // this may race with the device writing new entries to
+  // the "used" ring, in which case we may process the new
+  // completion entries in this softirq, and have nothing to
+  // do in the next one, which is harmless.
+  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  __sync_fetch_and_add(&disk.nintr, 1);
+
+  raise_softirq(SOFTIRQ_DISK);
+}
+
+// finish up to DISK_BUDGET of the requests the device has
+// put in dq's used ring, polling with dq's interrupts off.
+// returns 1 if the budget ran out, or more arrived as the
+// interrupts went back on, so dq should be polled again.
+static int
+virtio_disk_poll(struct diskq *dq)
+{
+  struct blkreq *r, *done;
+  struct diskslot *s;
+  int n, again;
+
+  n = 0;
+  done = 0;
+  acquire(&dq->vq.lock);
+  virtq_disable_cb(&dq->vq);
+  while(n < DISK_BUDGET && (s = virtq_get(&dq->vq, 0)) != 0){
+    r = s->r;
+    r->status = s->status == 0 ? 0 : -EIO;
+    s->r = 0;
+    s->next = dq->free;
+    dq->free = s;
+    n++;
+
+    if(r->done){
+      r->next = done;
+      done = r;
+    } else {
+      r->complete = 1;
+      wakeup(r);
+    }
+  }
+  dq->nio += n;
+  if(n)
+    wakeup(dq);
+  // under load, stay in polling mode; once the ring
+  // runs dry, wait for interrupts again.
+  again = n == DISK_BUDGET || virtq_enable_cb(&dq->vq);
+  if(again)
+    virtq_disable_cb(&dq->vq);
+  release(&dq->vq.lock);
+
+  // outside the lock, so that done functions
+  // can take locks of their own.
+  while((r = done) != 0){
+    done = r->next;
+    r->complete = 1;
+    r->done(r);
+  }
+  return again;
+}
+
+// the bottom half: poll this hart's queue here, and have
+// the owners of the other queues with completions, or in
+// polling mode, poll theirs. the unlocked look at each used ring can only be
+// stale by completions that raise another interrupt.
+static void
+virtio_disk_softirq(void)
+{
+  struct diskq *dq;
+  int i;
+
+  for(i = 0; i < disk.nq; i++){
+    dq = &queues[i];
+    if(!virtq_pending(&dq->vq) && !dq->vq.polling)
+      continue;
+    if(i != cpuid())
+      queue_work_on(i, &disk.work[i]);
+    else if(virtio_disk_poll(dq))
+      raise_softirq(SOFTIRQ_DISK);
+  }
+}
+
+static void
+virtio_disk_work(struct work *w)
+{
+  int i = w - disk.work;
+
+  if(virtio_disk_poll(&queues[i]))
+    queue_work_on(i, w);
+}
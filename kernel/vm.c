@@ -32,6 +32,10 @@ kvmmake(void)
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
+  // the APLIC's supervisor domain, when booted with AIA;
+  // its machine domain lies inside the PLIC mapping.
+  kvmmap(kpgtbl, APLIC_S, APLIC_S, APLIC_SIZE, PTE_R | PTE_W);
+
   // map kernel text executable and read-only.
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
@@ -124,12 +128,81 @@ walkaddr(pagetable_t pagetable, uint64 va)
   return pa;
 }
 
+// Make the page table the kernel runs on while it serves the
+// process whose user page table is pagetable: the kernel's own
+// mappings plus the process's memory, so that copy_to_user()
+// and friends can let the MMU translate user addresses.
+// User memory lies below USERTOP, in the gigabyte that also
+// holds the devices, so both tables share a level-1 table
+// there whose device entries point at the kernel's own tables.
+// Those mappings lack PTE_U, so user mode cannot touch them.
+//
+// With GLOBALKVM, the kernel's text, direct map and devices go
+// into the user page table itself, which is then also the
+// kernel's, so traps need not switch page tables. The kernel
+// stacks come from the direct map in that mode (see procinit()),
+// since their usual addresses would collide with TRAPFRAME.
+//
+// Returns 0 if out of memory.
+pagetable_t
+kvmcreate(pagetable_t pagetable)
+{
+  pagetable_t kpgtbl, l1;
+
+  if(pagetable[0] & PTE_V)
+    panic("kvmcreate");
+  if((l1 = (pagetable_t) kalloc()) == 0)
+    return 0;
+  memmove(l1, (void*)PTE2PA(kernel_pagetable[0]), PGSIZE);
+#ifdef GLOBALKVM
+  kpgtbl = pagetable;
+  // entry 0 is the user's and the kernel's both, below;
+  // PX(2, TRAMPOLINE) holds the user's trampoline, trapframe,
+  // vDSO and ring pages. take the kernel's others.
+  for(int i = 1; i < 512; i++)
+    if(i != PX(2, TRAMPOLINE))
+      kpgtbl[i] = kernel_pagetable[i];
+#else
+  if((kpgtbl = (pagetable_t) kalloc()) == 0){
+    kfree(l1);
+    return 0;
+  }
+  memmove(kpgtbl, kernel_pagetable, PGSIZE);
+#endif
+  pagetable[0] = kpgtbl[0] = PA2PTE(l1) | PTE_V;
+  return kpgtbl;
+}
+
+// Free a table made by kvmcreate(). Detaches the kernel's
+// tables from it, so that uvmfree() will not free them
+// along with the user's.
+void
+kvmfree(pagetable_t kpgtbl)
+{
+  pagetable_t l1 = (pagetable_t)PTE2PA(kpgtbl[0]);
+
+  for(int i = PX(1, USERTOP); i < 512; i++)
+    l1[i] = 0;
+#ifdef GLOBALKVM
+  for(int i = 1; i < 512; i++)
+    if(i != PX(2, TRAMPOLINE))
+      kpgtbl[i] = 0;
+#else
+  kfree((void*)kpgtbl);
+#endif
+}
+
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
+// with GLOBALKVM the mapping is in every address space,
+// so the TLB may keep it across page table switches.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
+#ifdef GLOBALKVM
+  perm |= PTE_G;
+#endif
   if(mappages(kpgtbl, va, sz, pa, perm) != 0)
     panic("kvmmap");
 }
@@ -162,3 +235,169 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   }
   return 0;
 }
+
+// Remove npages of mappings starting from va. va must be
+// page-aligned. The mappings must exist.
+// Optionally free the physical memory.
+void
+uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
+{
+  uint64 a;
+  pte_t *pte;
+
+  if((va % PGSIZE) != 0)
+    panic("uvmunmap: not aligned");
+
+  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+    if((pte = walk(pagetable, a, 0)) == 0)
+      panic("uvmunmap: walk");
+    if((*pte & PTE_V) == 0)
+      panic("uvmunmap: not mapped");
+    if(PTE_FLAGS(*pte) == PTE_V)
+      panic("uvmunmap: not a leaf");
+    if(do_free){
+      uint64 pa = PTE2PA(*pte);
+      kfree((void*)pa);
+    }
+    *pte = 0;
+  }
+}
+
+// create an empty user page table.
+// returns 0 if out of memory.
+pagetable_t
+uvmcreate()
+{
+  pagetable_t pagetable;
+  pagetable = (pagetable_t) kalloc();
+  if(pagetable == 0)
+    return 0;
+  memset(pagetable, 0, PGSIZE);
+  return pagetable;
+}
+
+// Load a flat program image at address 0 of pagetable,
+// for user processes the kernel starts itself.
+// Returns the size mapped, or 0 if out of memory.
+uint64
+uvmload(pagetable_t pagetable, uchar *src, uint sz)
+{
+  uint64 a, n, pa;
+
+  if(uvmalloc(pagetable, 0, sz, PTE_W|PTE_X) == 0)
+    return 0;
+  for(a = 0; a < sz; a += PGSIZE){
+    pa = walkaddr(pagetable, a);
+    n = sz - a < PGSIZE ? sz - a : PGSIZE;
+    memmove((void*)pa, src + a, n);
+  }
+  return PGROUNDUP(sz);
+}
+
+// Allocate PTEs and physical memory to grow process from oldsz to
+// newsz, which need not be page aligned.  Returns new size or 0 on error.
+uint64
+uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
+{
+  char *mem;
+  uint64 a;
+
+  if(newsz < oldsz)
+    return oldsz;
+  if(newsz > USERTOP)
+    return 0;
+
+  oldsz = PGROUNDUP(oldsz);
+  for(a = oldsz; a < newsz; a += PGSIZE){
+    mem = kalloc();
+    if(mem == 0){
+      uvmdealloc(pagetable, a, oldsz);
+      return 0;
+    }
+    memset(mem, 0, PGSIZE);
+    if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
+      kfree(mem);
+      uvmdealloc(pagetable, a, oldsz);
+      return 0;
+    }
+  }
+  return newsz;
+}
+
+// Deallocate user pages to bring the process size from oldsz to
+// newsz.  oldsz and newsz need not be page-aligned, nor does newsz
+// need to be less than oldsz.  oldsz can be larger than the actual
+// process size.  Returns the new process size.
+uint64
+uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
+{
+  if(newsz >= oldsz)
+    return oldsz;
+
+  if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
+    int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
+    uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
+  }
+
+  return newsz;
+}
+
+// Handle a store to the copy-on-write page at va: give the
+// process a private copy of the page if others still refer to
+// it, and make it writable. Returns 0 if the store can be
+// retried, or -1 if va isn't copy-on-write or out of memory.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  char *mem;
+
+  if(va >= USERTOP)
+    return -1;
+  if((pte = walk(pagetable, va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  if(krefcount((void*)pa) > 1){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, (void*)pa, PGSIZE);
+    *pte = PA2PTE(mem) | PTE_FLAGS(*pte);
+    kfree((void*)pa);
+  }
+  *pte = (*pte | PTE_W) & ~PTE_COW;
+  sfence_vma();
+  return 0;
+}
+
+// Recursively free page-table pages.
+// All leaf mappings must already have been removed.
+void
+freewalk(pagetable_t pagetable)
+{
+  // there are 2^9 = 512 PTEs in a page table.
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0){
+      // this PTE points to a lower-level page table.
+      uint64 child = PTE2PA(pte);
+      freewalk((pagetable_t)child);
+      pagetable[i] = 0;
+    } else if(pte & PTE_V){
+      panic("freewalk: leaf");
+    }
+  }
+  kfree((void*)pagetable);
+}
+
+// Free user memory pages,
+// then free page-table pages.
+void
+uvmfree(pagetable_t pagetable, uint64 sz)
+{
+  if(sz > 0)
+    uvmunmap(pagetable, 0, PGROUNDUP(sz)/PGSIZE, 1);
+  freewalk(pagetable);
+}
@@ -0,0 +1,150 @@
+//
+// per-CPU workqueues.
+//
+// interrupt handlers queue_work() the slow part of their
+// job and return; a kernel thread bound to the same cpu
+// runs it later with interrupts enabled.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "workqueue.h"
+#include "defs.h"
+
+struct workqueue {
+  struct spinlock lock;
+  struct work *head;
+  struct work *tail;
+  struct work *running;   // work the worker is executing
+  struct proc *worker;
+};
+
+static struct workqueue workqueues[NCPU];
+
+static void worker(void*);
+
+// set up a worker thread for every cpu.
+// called once, on hart 0, before scheduling starts.
+void
+workqueueinit(void)
+{
+  struct workqueue *wq;
+  char name[16];
+  int i;
+
+  for(i = 0; i < NCPU; i++){
+    wq = &workqueues[i];
+    initlock(&wq->lock, "workqueue");
+    wq->head = wq->tail = 0;
+    wq->running = 0;
+    safestrcpy(name, "kworker/0", sizeof(name));
+    name[8] = '0' + i;
+    if((wq->worker = kthread_create(worker, wq, name, i)) == 0)
+      panic("workqueueinit");
+  }
+}
+
+void
+initwork(struct work *w, void (*fn)(struct work*))
+{
+  w->fn = fn;
+  w->next = 0;
+  w->wq = 0;
+  w->pending = 0;
+}
+
+// queue w on cpu's workqueue, unless it is already
+// pending. safe to call from interrupt handlers.
+// returns 1 if w was queued, 0 if it was already pending.
+int
+queue_work_on(int cpu, struct work *w)
+{
+  struct workqueue *wq = &workqueues[cpu];
+
+  // claim w before taking any queue's lock: harts queueing
+  // it on different cpus hold different locks, and only one
+  // of them may put it on a list.
+  if(__sync_lock_test_and_set(&w->pending, 1))
+    return 0;
+
+  acquire(&wq->lock);
+  w->wq = wq;
+  w->next = 0;
+  if(wq->tail)
+    wq->tail->next = w;
+  else
+    wq->head = w;
+  wq->tail = w;
+  release(&wq->lock);
+
+  // the worker is the only thread that sleeps on wq.
+  wakeup_proc(wq->worker, wq);
+
+  return 1;
+}
+
+// queue w on the current cpu's workqueue.
+int
+queue_work(struct work *w)
+{
+  int r;
+
+  push_off();
+  r = queue_work_on(cpuid(), w);
+  pop_off();
+  return r;
+}
+
+// wait until w is neither queued nor running.
+// must be called from process context.
+void
+flush_work(struct work *w)
+{
+  struct workqueue *wq;
+
+  for(;;){
+    if((wq = w->wq) == 0)
+      return;
+    acquire(&wq->lock);
+    if(w->wq != wq){
+      // queued on another cpu meanwhile; wait there.
+      release(&wq->lock);
+      continue;
+    }
+    if(!w->pending && wq->running != w)
+      break;
+    sleep(w, &wq->lock);
+    release(&wq->lock);
+  }
+  release(&wq->lock);
+}
+
+static void
+worker(void *arg)
+{
+  struct workqueue *wq = arg;
+  struct work *w;
+
+  acquire(&wq->lock);
+  for(;;){
+    while((w = wq->head) == 0)
+      sleep(wq, &wq->lock);
+    wq->head = w->next;
+    if(wq->head == 0)
+      wq->tail = 0;
+    wq->running = w;
+    __sync_lock_release(&w->pending);
+    release(&wq->lock);
+
+    w->fn(w);
+
+    acquire(&wq->lock);
+    wq->running = 0;
+    // maybe flush_work() is waiting.
+    wakeup(w);
+  }
+}
@@ -0,0 +1,8 @@
+// A unit of deferred work, run in process context by
+// the per-CPU worker thread of the queue it was put on.
+struct work {
+  void (*fn)(struct work*);  // called by the worker
+  struct work *next;         // next on the queue
+  struct workqueue *wq;      // queue this work was last put on
+  int pending;               // queued and not yet started; set atomically
+};
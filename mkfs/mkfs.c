@@ -20,7 +20,7 @@
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
 
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
+int nbitmap = (FSSIZE + BPB - 1) / BPB;
 int ninodeblocks = NINODES / IPB + 1;
 int nlog = LOGSIZE;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
@@ -31,6 +31,7 @@ struct superblock sb;
 char zeroes[BSIZE];
 uint freeinode = 1;
 uint freeblock;
+int version = FSV_EXTENT;
 
 
 void balloc(int);
@@ -39,7 +40,9 @@ void winode(uint, struct dinode*);
 void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
+uint bmap(struct dinode *din, uint fbn);
 void iappend(uint inum, void *p, int n);
+void dxappend(uint inum, struct dirent *de);
 void die(const char *);
 
 // convert to riscv byte order
@@ -69,21 +72,31 @@ int
 main(int argc, char *argv[])
 {
   int i, cc, fd;
-  uint rootino, inum, off;
+  uint rootino, inum;
   struct dirent de;
   char buf[BSIZE];
-  struct dinode din;
+  struct dxslot *x;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  // -c makes a classic file system, with files mapped
+  // by block addresses instead of extents.
+  if(argc > 1 && strcmp(argv[1], "-c") == 0){
+    version = FSV_CLASSIC;
+    argc--;
+    argv++;
+  }
+
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-c] fs.img files...\n");
     exit(1);
   }
 
   assert((BSIZE % sizeof(struct dinode)) == 0);
   assert((BSIZE % sizeof(struct dirent)) == 0);
+  assert(sizeof(struct dxslot) == sizeof(struct dirent));
+  assert(DXBUCKETS <= DXMAXBUCKET);
 
   fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0)
@@ -101,9 +114,11 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.version = xint(version);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d, %s\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE,
+         version == FSV_EXTENT ? "extents" : "classic");
 
   freeblock = nmeta;     // the first free block that we can allocate
 
@@ -117,15 +132,17 @@ main(int argc, char *argv[])
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  // the root directory is indexed: its first block is
+  // ".", "..", and the index, with every bucket empty.
+  memset(buf, 0, sizeof(buf));
+  x = (struct dxslot*)buf;
+  x[0].inum = xshort(rootino);
+  strcpy(((struct dirent*)&x[0])->name, ".");
+  x[1].inum = xshort(rootino);
+  strcpy(((struct dirent*)&x[1])->name, "..");
+  x[2].w[0] = xint(DXMAGIC);
+  x[2].w[1] = xint(DXBUCKETS);
+  iappend(rootino, buf, BSIZE);
 
   for(i = 2; i < argc; i++){
     // get rid of "user/"
@@ -152,7 +169,7 @@ main(int argc, char *argv[])
     bzero(&de, sizeof(de));
     de.inum = xshort(inum);
     strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    dxappend(rootino, &de);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -160,13 +177,6 @@ main(int argc, char *argv[])
     close(fd);
   }
 
-  // fix size of root inode dir
-  rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
-
   balloc(freeblock);
 
   exit(0);
@@ -231,24 +241,97 @@ ialloc(ushort type)
   return inum;
 }
 
+// mark the first used blocks allocated, in as many
+// bitmap blocks as that takes.
 void
 balloc(int used)
 {
   uchar buf[BSIZE];
-  int i;
+  int i, b;
 
   printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < BSIZE*8);
-  bzero(buf, BSIZE);
-  for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  assert(used <= FSSIZE);
+  for(b = 0; b * BPB < used; b++){
+    bzero(buf, BSIZE);
+    for(i = 0; i < BPB && b * BPB + i < used; i++){
+      buf[i/8] = buf[i/8] | (0x1 << (i%8));
+    }
+    printf("balloc: write bitmap block at sector %d\n", xint(sb.bmapstart) + b);
+    wsect(xint(sb.bmapstart) + b, buf);
   }
-  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
 }
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// the disk block that holds block fbn of the file din,
+// allocating it if fbn is the block after the file's last.
+// blocks are allocated in order, so a file's blocks are
+// contiguous unless another file's came in between.
+uint
+bmap(struct dinode *din, uint fbn)
+{
+  uint indirect[NINDIRECT];
+  struct extent ext[NEXTENTBLK], *e, *last;
+  uint lbn;
+  int i, n;
+
+  if(version == FSV_CLASSIC){
+    assert(fbn < MAXFILE);
+    if(fbn < NDIRECT){
+      if(xint(din->addrs[fbn]) == 0){
+        din->addrs[fbn] = xint(freeblock++);
+      }
+      return xint(din->addrs[fbn]);
+    }
+    if(xint(din->addrs[NDIRECT]) == 0){
+      din->addrs[NDIRECT] = xint(freeblock++);
+    }
+    rsect(xint(din->addrs[NDIRECT]), (char*)indirect);
+    if(indirect[fbn - NDIRECT] == 0){
+      indirect[fbn - NDIRECT] = xint(freeblock++);
+      wsect(xint(din->addrs[NDIRECT]), (char*)indirect);
+    }
+    return xint(indirect[fbn-NDIRECT]);
+  }
+
+  lbn = 0;
+  last = 0;
+  n = -1;   // index of last, then of the extent that changes
+  if(xint(din->extblock))
+    rsect(xint(din->extblock), (char*)ext);
+  else
+    bzero(ext, sizeof(ext));
+  for(i = 0; i < NEXTENT + NEXTENTBLK; i++){
+    e = i < NEXTENT ? &din->ext[i] : &ext[i - NEXTENT];
+    if(xint(e->len) == 0)
+      break;
+    if(fbn < lbn + xint(e->len))
+      return xint(e->start) + fbn - lbn;
+    lbn += xint(e->len);
+    last = e;
+    n = i;
+  }
+  assert(fbn == lbn);
+  if(last && xint(last->start) + xint(last->len) == freeblock){
+    last->len = xint(xint(last->len) + 1);
+  } else {
+    assert(i < NEXTENT + NEXTENTBLK);
+    if(i == NEXTENT){
+      din->extblock = xint(freeblock++);
+      bzero(ext, sizeof(ext));
+    }
+    e = i < NEXTENT ? &din->ext[i] : &ext[i - NEXTENT];
+    e->start = xint(freeblock);
+    e->len = xint(1);
+    n = i;
+  }
+  // write the overflow block if the extent that
+  // changed is in it.
+  if(n >= NEXTENT)
+    wsect(xint(din->extblock), (char*)ext);
+  return freeblock++;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -256,7 +339,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -264,23 +346,7 @@ iappend(uint inum, void *xp, int n)
   // printf("append inum %d at off %d sz %d\n", inum, off, n);
   while(n > 0){
     fbn = off / BSIZE;
-    assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = bmap(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -293,6 +359,75 @@ iappend(uint inum, void *xp, int n)
   winode(inum, &din);
 }
 
+// the hash of a name, as in kernel/fs.c.
+uint
+dxhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// add de to the indexed directory inum: in the last block of
+// its bucket's chain if there's room, or else in a new block
+// on the end of the directory, linked onto the chain.
+void
+dxappend(uint inum, struct dirent *de)
+{
+  char root[BSIZE], buf[BSIZE];
+  struct dinode din;
+  struct dxslot *x;
+  uint b, lbn, prev, addr, *link;
+  int i;
+
+  rinode(inum, &din);
+  rsect(bmap(&din, 0), root);
+  x = (struct dxslot*)root;
+  assert(xint(x[2].w[0]) == DXMAGIC);
+  b = dxhash(de->name) % xint(x[2].w[1]);
+
+  prev = 0;
+  lbn = xint(x[3 + b/3].w[b%3]);
+  while(lbn != 0){
+    addr = bmap(&din, lbn);
+    rsect(addr, buf);
+    for(i = 0; i < DXPERBLOCK; i++){
+      if(((struct dirent*)buf)[i].inum == 0){
+        ((struct dirent*)buf)[i] = *de;
+        wsect(addr, buf);
+        return;
+      }
+    }
+    prev = lbn;
+    lbn = xint(((struct dxslot*)buf)[DXPERBLOCK].w[0]);
+  }
+
+  lbn = xint(din.size) / BSIZE;
+  addr = bmap(&din, lbn);
+  memset(buf, 0, sizeof(buf));
+  ((struct dirent*)buf)[0] = *de;
+  wsect(addr, buf);
+  din.size = xint(xint(din.size) + BSIZE);
+  winode(inum, &din);
+
+  if(prev == 0){
+    link = &x[3 + b/3].w[b%3];
+    addr = bmap(&din, 0);
+  } else {
+    addr = bmap(&din, prev);
+    rsect(addr, root);
+    link = &((struct dxslot*)root)[DXPERBLOCK].w[0];
+  }
+  *link = xint(lbn);
+  wsect(addr, root);
+}
+
 void
 die(const char *s)
 {
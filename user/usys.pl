@@ -5,6 +5,9 @@
 print "# generated by usys.pl - do not edit\n";
 
 print "#include \"kernel/syscall.h\"\n";
+print "#include \"kernel/riscv.h\"\n";
+print "#include \"kernel/memlayout.h\"\n";
+print "#include \"kernel/vdso.h\"\n";
 
 sub entry {
     my $name = shift;
@@ -14,6 +17,34 @@ sub entry {
     print " ecall\n";
     print " ret\n";
 }
+
+# calls answered from the vDSO page (kernel/vdso.h)
+# without a trap. the body reads it through t0.
+sub vdso {
+    my $name = shift;
+    my $body = shift;
+    print ".global $name\n";
+    print "${name}:\n";
+    print " li t0, VDSO\n";
+    print $body;
+    print " ret\n";
+}
+
+# read a field that is written under the sequence lock.
+sub vdso_seq {
+    my $name = shift;
+    my $read = shift;
+    vdso($name,
+         "1:\n" .
+         " lw t1, VDSO_SEQ(t0)\n" .
+         " andi t2, t1, 1\n" .
+         " bnez t2, 1b\n" .
+         " fence r, r\n" .
+         $read .
+         " fence r, r\n" .
+         " lw t2, VDSO_SEQ(t0)\n" .
+         " bne t1, t2, 1b\n");
+}
 	
 entry("fork");
 entry("exit");
@@ -32,7 +63,33 @@ entry("link");
 entry("mkdir");
 entry("chdir");
 entry("dup");
-entry("getpid");
+vdso("getpid", " lw a0, VDSO_PID(t0)\n");
 entry("sbrk");
 entry("sleep");
-entry("uptime");
+vdso_seq("uptime",
+         " rdtime a0\n" .
+         " ld t2, VDSO_TIME_OFFSET(t0)\n" .
+         " sub a0, a0, t2\n" .
+         " ld t2, VDSO_TIME_PERTICK(t0)\n" .
+         " divu a0, a0, t2\n");
+vdso_seq("gethart", " lw a0, VDSO_HART(t0)\n");
+entry("futex_wait");
+entry("futex_wake");
+entry("null");
+entry("ring_setup");
+entry("ring_enter");
+entry("yield");
+entry("ipc_call");
+entry("ipc_reply");
+entry("ipc_reply_wait");
+entry("shm_create");
+entry("shm_map");
+entry("shm_unmap");
+entry("vmsplice");
+entry("epoll_create");
+entry("epoll_ctl");
+entry("epoll_wait");
+entry("timerfd");
+entry("ipc_open");
+entry("fsync");
+entry("shm_unlink");